@@ -0,0 +1,122 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "hash.h"
+// size_t
+#include <cstddef>
+// uintptr_t
+#include <stdint.h>
+// std::bad_alloc
+#include <new>
+
+#ifdef __linux__
+#   include <sys/mman.h>
+#endif
+
+namespace jvn
+{
+
+    // An allocator backing the allocations of at least Threshold bytes with huge pages, meant for
+    // the bucket of a large unordered_map. With 4 KB pages nearly every lookup in a table much
+    // larger than the TLB reach misses the TLB, a 2 MB page covers 512 times as much memory.
+    // The smaller allocations are left to operator new.
+
+    // On Linux a large allocation first tries explicit huge pages (MAP_HUGETLB), 1 GB pages if
+    // rounding up to them wastes at most an eighth, which only succeeds if the pages were reserved
+    // (vm.nr_hugepages). Otherwise the mapping is 2 MB aligned and madvise(MADV_HUGEPAGE) asks for
+    // transparent huge pages, granted when /sys/kernel/mm/transparent_hugepage/enabled is
+    // "always" or "madvise". Elsewhere every allocation is left to operator new.
+    template <class Ty, size_t Threshold = (size_t(2) << 20)>
+    class huge_page_allocator
+    {
+    public:
+        using value_type            = Ty;
+        using size_type             = size_t;
+        using difference_type       = ptrdiff_t;
+
+        // Needed since allocator_traits only rebinds the type parameters
+        template <class U>
+        struct rebind { using other = huge_page_allocator<U, Threshold>; };
+
+        huge_page_allocator() noexcept = default;
+        template <class U>
+        huge_page_allocator(const huge_page_allocator<U, Threshold>&) noexcept {}
+
+        Ty* allocate(size_type count)
+        {
+            if (count > size_type(-1) / sizeof(Ty))
+                throw std::bad_alloc();
+            auto bytes = count * sizeof(Ty);
+#ifdef __linux__
+            if (bytes >= Threshold)
+                return static_cast<Ty*>(mapPages(bytes));
+#endif
+            return static_cast<Ty*>(::operator new(bytes));
+        }
+
+        void deallocate(Ty* ptr, size_type count) noexcept
+        {
+            auto bytes = count * sizeof(Ty);
+#ifdef __linux__
+            if (bytes >= Threshold)
+            {
+                ::munmap(ptr, roundUp(bytes, pageSize(bytes)));
+                return;
+            }
+#endif
+            ::operator delete(ptr);
+        }
+
+        template <class U>
+        friend bool operator==(const huge_page_allocator&, const huge_page_allocator<U, Threshold>&) noexcept { return true; }
+        template <class U>
+        friend bool operator!=(const huge_page_allocator&, const huge_page_allocator<U, Threshold>&) noexcept { return false; }
+
+    private:
+        static JVN_INLINE_VAR constexpr size_t PAGE_2MB = size_t(1) << 21;
+        static JVN_INLINE_VAR constexpr size_t PAGE_1GB = size_t(1) << 30;
+
+        static constexpr size_t roundUp(size_t num, size_t multiple) noexcept
+        {
+            return (num + multiple - 1) & ~(multiple - 1);
+        }
+
+        // The mapping is always a whole number of these, so deallocate() can recompute its length
+        static constexpr size_t pageSize(size_t bytes) noexcept
+        {
+            return bytes >= PAGE_1GB && roundUp(bytes, PAGE_1GB) - bytes <= bytes / 8 ? PAGE_1GB : PAGE_2MB;
+        }
+
+#ifdef __linux__
+        static void* mapPages(size_t bytes)
+        {
+            auto page = pageSize(bytes);
+            auto length = roundUp(bytes, page);
+#ifdef MAP_HUGETLB
+            auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#   ifdef MAP_HUGE_SHIFT
+            flags |= (page == PAGE_1GB ? 30 : 21) << MAP_HUGE_SHIFT;
+#   endif
+            auto huge = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (huge != MAP_FAILED)
+                return huge;
+#endif
+            // Mapped with an extra 2 MB and trimmed, so the huge pages start at the beginning
+            auto raw = ::mmap(nullptr, length + PAGE_2MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED)
+                throw std::bad_alloc();
+            auto begin = uintptr_t(raw);
+            auto aligned = roundUp(begin, PAGE_2MB);
+            if (aligned != begin)
+                ::munmap(raw, aligned - begin);
+            if (begin + PAGE_2MB != aligned)
+                ::munmap(reinterpret_cast<void*>(aligned + length), begin + PAGE_2MB - aligned);
+#ifdef MADV_HUGEPAGE
+            // Only a hint, the memory is usable either way
+            ::madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+#endif
+            return reinterpret_cast<void*>(aligned);
+        }
+#endif
+    };
+
+} // namespace jvn
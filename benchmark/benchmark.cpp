@@ -0,0 +1,402 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+
+// Benchmark of jvn::unordered_map against std::unordered_map.
+// find_batch uses the batched lookup of jvn::unordered_map and plain find() for the other maps.
+// Every workload is run for int, pointer and std::string keys, small and large values,
+// several load factors and uniform and Zipfian distributed lookups. The time is reported
+// in ns per operation and the memory as the peak number of bytes held by the map's allocator.
+//
+// Build : g++ -std=c++17 -O2 -DNDEBUG -march=native -pthread -I.. benchmark.cpp -o benchmark
+// Usage : benchmark [element_count = 1000000] [filter]
+//         Only the rows containing the filter string are run, e.g. "jvn" or "string/large"
+//
+// Another map is benchmarked by adding an adapter like the ones below to run_maps().
+
+#include "../map.h"
+#include "../allocator.h"
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+// Memory accounting --------------------------------
+
+struct memory_counter
+{
+    static size_t current, peak;
+
+    static void add(size_t bytes) noexcept
+    {
+        current += bytes;
+        peak = std::max(peak, current);
+    }
+    static void sub(size_t bytes) noexcept { current -= bytes; }
+    static void reset() noexcept { peak = current; }
+};
+size_t memory_counter::current = 0;
+size_t memory_counter::peak = 0;
+
+// An allocator that records the number of bytes held by the containers, allocating from Base
+template <class Ty, template <class> class Base = std::allocator>
+struct counting_allocator
+{
+    using value_type        = Ty;
+    using size_type         = size_t;
+    using difference_type   = ptrdiff_t;
+
+    template <class U>
+    struct rebind { using other = counting_allocator<U, Base>; };
+
+    counting_allocator() noexcept = default;
+    template <class U>
+    counting_allocator(const counting_allocator<U, Base>&) noexcept {}
+
+    Ty* allocate(size_t count)
+    {
+        memory_counter::add(count * sizeof(Ty));
+        return Base<Ty>().allocate(count);
+    }
+    void deallocate(Ty* ptr, size_t count) noexcept
+    {
+        memory_counter::sub(count * sizeof(Ty));
+        Base<Ty>().deallocate(ptr, count);
+    }
+
+    template <class U>
+    friend bool operator==(const counting_allocator&, const counting_allocator<U, Base>&) noexcept { return true; }
+    template <class U>
+    friend bool operator!=(const counting_allocator&, const counting_allocator<U, Base>&) noexcept { return false; }
+};
+
+// The bucket of a table over 2 MB in huge pages
+template <class Ty>
+using huge_pages = jvn::huge_page_allocator<Ty>;
+
+// Keys and values ----------------------------------
+
+struct small_value
+{
+    small_value() = default;
+    small_value(size_t val) :data(uint32_t(val)) {}
+    uint32_t data = 0;
+    size_t sum() const noexcept { return data; }
+};
+
+struct large_value
+{
+    large_value() = default;
+    large_value(size_t val) { data[0] = val; }
+    size_t data[32] = {};
+    size_t sum() const noexcept { return data[0]; }
+};
+
+template <class Ty> struct type_name;
+template <> struct type_name<int>           { static const char* get() { return "int"; } };
+template <> struct type_name<const int*>    { static const char* get() { return "pointer"; } };
+template <> struct type_name<std::string>   { static const char* get() { return "string"; } };
+template <> struct type_name<small_value>   { static const char* get() { return "small"; } };
+template <> struct type_name<large_value>   { static const char* get() { return "large"; } };
+
+// Generates count unique keys, the first half is inserted and the second half is used for
+// the unsuccessful lookups
+template <class Kt>
+struct key_generator;
+
+template <>
+struct key_generator<int>
+{
+    static std::vector<int> generate(size_t count, std::mt19937_64& rng)
+    {
+        std::vector<int> keys(count);
+        for (size_t i = 0; i < count; ++i)
+            keys[i] = int(i * 7 + 3);
+        std::shuffle(keys.begin(), keys.end(), rng);
+        return keys;
+    }
+};
+
+template <>
+struct key_generator<const int*>
+{
+    // Addresses of distinct objects, the low bits are always the same as with real pointers
+    static std::vector<int> storage;
+
+    static std::vector<const int*> generate(size_t count, std::mt19937_64& rng)
+    {
+        storage.assign(count, 0);
+        std::vector<const int*> keys(count);
+        for (size_t i = 0; i < count; ++i)
+            keys[i] = &storage[i];
+        std::shuffle(keys.begin(), keys.end(), rng);
+        return keys;
+    }
+};
+std::vector<int> key_generator<const int*>::storage;
+
+template <>
+struct key_generator<std::string>
+{
+    // Strings of 12 to 40 characters, the index keeps them unique
+    static std::vector<std::string> generate(size_t count, std::mt19937_64& rng)
+    {
+        std::vector<std::string> keys(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto length = 12 + rng() % 29;
+            keys[i] = std::to_string(i) + '_';
+            while (keys[i].size() < length)
+                keys[i] += char('a' + rng() % 26);
+        }
+        std::shuffle(keys.begin(), keys.end(), rng);
+        return keys;
+    }
+};
+
+// Indices of the keys that are looked up
+enum class distribution { uniform, zipfian };
+
+inline const char* distribution_name(distribution dist) { return dist == distribution::uniform ? "uniform" : "zipf"; }
+
+inline std::vector<size_t> generate_indices(size_t key_count, size_t count, distribution dist, std::mt19937_64& rng)
+{
+    std::vector<size_t> indices(count);
+    if (dist == distribution::uniform)
+    {
+        std::uniform_int_distribution<size_t> uniform(0, key_count - 1);
+        for (auto& idx : indices)
+            idx = uniform(rng);
+        return indices;
+    }
+
+    // Zipfian distribution with s = 0.99, sampled by a binary search of the cdf
+    std::vector<double> cdf(key_count);
+    auto sum = 0.0;
+    for (size_t i = 0; i < key_count; ++i)
+        cdf[i] = sum += 1.0 / std::pow(double(i + 1), 0.99);
+    std::uniform_real_distribution<double> uniform(0.0, sum);
+    for (auto& idx : indices)
+        idx = size_t(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+    return indices;
+}
+
+// Maps ---------------------------------------------
+
+// The adapters' table types are constructed in place, a node_map can't be copied or moved.
+// A growing table starts small and doubles, i.e. most of the inserts are spent in grow()
+struct growing_tag {};
+
+template <class Kt, class Vt, class Layout, bool StoreHash = false, class Storage = jvn::flat_storage,
+    template <class> class Base = std::allocator, class Hasher = jvn::hash<Kt>, class Range = jvn::default_range_t<Hasher>>
+struct jvn_map
+{
+    using map = jvn::unordered_map<Kt, Vt, Hasher, jvn::equal_to<Kt>,
+        counting_allocator<jvn::pair<Kt, Vt>, Base>, Layout, StoreHash, Storage, Range>;
+
+    static const char* name()
+    {
+        if (std::is_same<Range, jvn::fibonacci_range>::value)
+            return "jvn::interleaved+identity+fibonacci";
+        if (std::is_same<Range, jvn::mix_range>::value)
+            return "jvn::interleaved+identity+mix";
+        if (std::is_same<Base<int>, huge_pages<int>>::value)
+            return "jvn::interleaved+huge_pages";
+        if (std::is_same<Storage, jvn::node_storage>::value)
+            return "jvn::node_map";
+        if (std::is_same<Layout, jvn::separate_layout>::value)
+            return StoreHash ? "jvn::separate+hash" : "jvn::separate";
+        if (std::is_same<Layout, jvn::grouped_layout<>>::value)
+            return StoreHash ? "jvn::grouped+hash" : "jvn::grouped";
+        return StoreHash ? "jvn::interleaved+hash" : "jvn::interleaved";
+    }
+    struct table : map
+    {
+        explicit table(float load_factor) :map(load_factor) {}
+        table(float load_factor, growing_tag) :map(load_factor, 2u, 2u) {}
+    };
+    static void insert(map& m, const Kt& key, const Vt& val) { m.insert(jvn::pair<Kt, Vt>(key, val)); }
+    static size_t find_batch(const map& m, const std::vector<Kt>& keys, std::vector<bool>& found)
+    {
+        m.contains_batch(keys.begin(), keys.end(), found.begin());
+        return size_t(std::count(found.begin(), found.end(), true));
+    }
+};
+
+template <class Kt, class Vt>
+struct std_map
+{
+    using map = std::unordered_map<Kt, Vt, std::hash<Kt>, std::equal_to<Kt>,
+        counting_allocator<std::pair<const Kt, Vt>>>;
+
+    static const char* name() { return "std::unordered_map"; }
+    struct table : map
+    {
+        explicit table(float load_factor) { this->max_load_factor(load_factor); }
+        table(float load_factor, growing_tag) :table(load_factor) {}
+    };
+    static void insert(map& m, const Kt& key, const Vt& val) { m.insert(std::pair<const Kt, Vt>(key, val)); }
+    // No batched lookup, the keys are looked up one by one
+    static size_t find_batch(const map& m, const std::vector<Kt>& keys, std::vector<bool>& found)
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+            found[i] = m.find(keys[i]) != m.end();
+        return size_t(std::count(found.begin(), found.end(), true));
+    }
+};
+
+// Workloads ----------------------------------------
+
+struct config
+{
+    size_t element_count;
+    const char* filter;
+};
+
+using clock_type = std::chrono::steady_clock;
+
+// Keeps the optimizer from removing the measured work
+static volatile size_t sink;
+
+inline void report(const char* row, const char* op, clock_type::time_point start, size_t ops, size_t peak)
+{
+    auto ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    std::printf("%-64s %-12s %10.2f ns/op %10.2f MB\n", row, op, ns / double(ops), double(peak) / (1024.0 * 1024.0));
+}
+
+template <class Map, class Kt, class Vt>
+void run_workloads(const config& cfg, float load_factor, distribution dist)
+{
+    char row[256];
+    std::snprintf(row, sizeof(row), "%s/%s/%s/lf%.2f/%s", Map::name(), type_name<Kt>::get(),
+        type_name<Vt>::get(), load_factor, distribution_name(dist));
+    if (cfg.filter && !std::strstr(row, cfg.filter))
+        return;
+
+    std::mt19937_64 rng(0x5eed);
+    auto count = cfg.element_count;
+    auto keys = key_generator<Kt>::generate(count * 2, rng);
+    auto indices = generate_indices(count, count, dist, rng);
+    size_t sum = 0;
+
+    {
+        memory_counter::reset();
+        auto base = memory_counter::current;
+        typename Map::table m(load_factor);
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i)
+            Map::insert(m, keys[i], Vt(i));
+        report(row, "insert", start, count, memory_counter::peak - base);
+
+        start = clock_type::now();
+        for (auto idx : indices)
+            sum += m.find(keys[idx]) != m.end();
+        report(row, "find_hit", start, count, memory_counter::peak - base);
+
+        start = clock_type::now();
+        for (auto idx : indices)
+            sum += m.find(keys[count + idx]) != m.end();
+        report(row, "find_miss", start, count, memory_counter::peak - base);
+
+        {
+            std::vector<Kt> lookup_keys;
+            lookup_keys.reserve(count);
+            for (auto idx : indices)
+                lookup_keys.push_back(keys[idx]);
+            std::vector<bool> found(count);
+            start = clock_type::now();
+            sum += Map::find_batch(m, lookup_keys, found);
+            report(row, "find_batch", start, count, memory_counter::peak - base);
+        }
+
+        start = clock_type::now();
+        for (auto idx : indices)
+            sum += m[keys[idx]].sum();
+        report(row, "operator[]", start, count, memory_counter::peak - base);
+
+        start = clock_type::now();
+        for (auto& kv : m)
+            sum += kv.second.sum();
+        report(row, "iterate", start, count, memory_counter::peak - base);
+
+        start = clock_type::now();
+        for (size_t i = 0; i < count; ++i)
+            sum += m.erase(keys[i]);
+        report(row, "erase", start, count, memory_counter::peak - base);
+    }
+
+    {
+        memory_counter::reset();
+        auto base = memory_counter::current;
+        typename Map::table m(load_factor, growing_tag());
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i)
+            Map::insert(m, keys[i], Vt(i));
+        report(row, "grow", start, count, memory_counter::peak - base);
+    }
+
+    sink = sum;
+}
+
+// identity_hash with the ranges that mix its bits, only for the integer and pointer keys
+template <class Kt, class Vt>
+void run_identity_maps(const config& cfg, float load_factor, distribution dist, std::true_type)
+{
+    using identity = jvn::identity_hash<Kt>;
+    run_workloads<jvn_map<Kt, Vt, jvn::interleaved_layout, false, jvn::flat_storage, std::allocator, identity>, Kt, Vt>(cfg, load_factor, dist);
+    run_workloads<jvn_map<Kt, Vt, jvn::interleaved_layout, false, jvn::flat_storage, std::allocator, identity, jvn::mix_range>, Kt, Vt>(cfg, load_factor, dist);
+}
+template <class Kt, class Vt>
+void run_identity_maps(const config&, float, distribution, std::false_type) {}
+
+template <class Kt, class Vt>
+void run_maps(const config& cfg)
+{
+    for (auto load_factor : { 0.5f, 0.75f, 0.9f })
+        for (auto dist : { distribution::uniform, distribution::zipfian })
+        {
+            run_workloads<jvn_map<Kt, Vt, jvn::interleaved_layout>, Kt, Vt>(cfg, load_factor, dist);
+            run_workloads<jvn_map<Kt, Vt, jvn::separate_layout>, Kt, Vt>(cfg, load_factor, dist);
+            run_workloads<jvn_map<Kt, Vt, jvn::separate_layout, true>, Kt, Vt>(cfg, load_factor, dist);
+            run_workloads<jvn_map<Kt, Vt, jvn::grouped_layout<>>, Kt, Vt>(cfg, load_factor, dist);
+            run_workloads<jvn_map<Kt, Vt, jvn::interleaved_layout, true, jvn::node_storage>, Kt, Vt>(cfg, load_factor, dist);
+            run_workloads<jvn_map<Kt, Vt, jvn::interleaved_layout, false, jvn::flat_storage, huge_pages>, Kt, Vt>(cfg, load_factor, dist);
+            run_identity_maps<Kt, Vt>(cfg, load_factor, dist,
+                std::integral_constant<bool, std::is_integral<Kt>::value || std::is_pointer<Kt>::value>());
+            run_workloads<std_map<Kt, Vt>, Kt, Vt>(cfg, load_factor, dist);
+        }
+}
+
+} // namespace bench
+
+int main(int argc, char** argv)
+{
+    bench::config cfg;
+    cfg.element_count = 1000000u;
+    if (argc > 1)
+    {
+        char* end = nullptr;
+        auto count = std::strtoull(argv[1], &end, 10);
+        if (end == argv[1] || *end || !count || argv[1][0] == '-')
+        {
+            std::fprintf(stderr, "Usage : %s [element_count = 1000000] [filter]\n", argv[0]);
+            return 1;
+        }
+        cfg.element_count = size_t(count);
+    }
+    cfg.filter = argc > 2 ? argv[2] : nullptr;
+
+    bench::run_maps<int, bench::small_value>(cfg);
+    bench::run_maps<int, bench::large_value>(cfg);
+    bench::run_maps<const int*, bench::small_value>(cfg);
+    bench::run_maps<const int*, bench::large_value>(cfg);
+    bench::run_maps<std::string, bench::small_value>(cfg);
+    bench::run_maps<std::string, bench::large_value>(cfg);
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+
+// Throughput of the byte range hashes of hash.h and std::hash.
+// Every hash is run over a set of keys of the same length, short keys (4 - 32 bytes) are
+// latency bound and long keys (1 KB and more) throughput bound. The time is reported in ns per
+// key and the throughput in GB/s. "bulk" hashes the same keys with hash_bulk().
+//
+// Build : g++ -std=c++17 -O2 -DNDEBUG -march=native -I.. hash_benchmark.cpp -o hash_benchmark
+// Usage : hash_benchmark [total_bytes = 256000000] [filter]
+//         Only the rows containing the filter string are run, e.g. "crc32c" or "/1024"
+
+#include "../hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench
+{
+
+struct config
+{
+    size_t total_bytes;
+    const char* filter;
+};
+
+// The keys are hashed until about total_bytes are hashed, but at least a few times
+template <class Func>
+void run(const config& cfg, const char* name, const std::vector<std::string>& keys, Func&& func)
+{
+    char row[128];
+    std::snprintf(row, sizeof(row), "%s/%zu", name, keys.front().size());
+    if (cfg.filter && !std::strstr(row, cfg.filter))
+        return;
+
+    auto rounds = std::max<size_t>(cfg.total_bytes / (keys.size() * keys.front().size()), 4);
+    // The hashes are summed so the compiler can't throw the hashing away
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round != rounds; ++round)
+        sink += func(keys);
+    auto stop = std::chrono::steady_clock::now();
+
+    auto ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    auto count = double(rounds * keys.size());
+    std::printf("%-32s %10.2f ns/key %8.2f GB/s  (%zx)\n", row, ns / count,
+        count * double(keys.front().size()) / ns, sink & 0xf);
+}
+
+template <class Hash>
+size_t hash_each(const std::vector<std::string>& keys, Hash&& hash)
+{
+    size_t sum = 0;
+    for (auto& key : keys)
+        sum += hash(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+    return sum;
+}
+
+void run_length(const config& cfg, size_t length)
+{
+    // Enough keys to stay in the L1 cache for short keys and about 256 KB for long ones
+    std::vector<std::string> keys(std::min(std::max<size_t>(256 * 1024 / length, 64), size_t(1024)));
+    std::mt19937_64 generator(length);
+    for (auto& key : keys)
+    {
+        key.resize(length);
+        for (auto& ch : key)
+            ch = char('a' + generator() % 26);
+    }
+
+    run(cfg, "murmur_hash2", keys, [](const std::vector<std::string>& k)
+        { return hash_each(k, [](const unsigned char* b, size_t c) { return jvn::murmur_hash::murmur_hash2(b, c); }); });
+#if JVN(BITNESS) == 64
+    run(cfg, "murmur_hash2_bytes", keys, [](const std::vector<std::string>& k)
+        { return hash_each(k, [](const unsigned char* b, size_t c) { return jvn::murmur_hash::murmur_hash2_bytes(b, c); }); });
+#endif
+    run(cfg, "fnv_1a", keys, [](const std::vector<std::string>& k)
+        { return hash_each(k, [](const unsigned char* b, size_t c) { return jvn::fnv::fnv_1a(jvn::fnv::FNV_OFFSET_BASIS, b, c); }); });
+#if JVN(BITNESS) == 64
+    run(cfg, "wyhash", keys, [](const std::vector<std::string>& k)
+        { return hash_each(k, [](const unsigned char* b, size_t c) { return size_t(jvn::wyhash::wyhash(b, c)); }); });
+    run(cfg, "crc32c", keys, [](const std::vector<std::string>& k)
+        { return hash_each(k, [](const unsigned char* b, size_t c) { return size_t(jvn::crc32c::hash(b, c)); }); });
+    run(cfg, "crc32c_software", keys, [](const std::vector<std::string>& k)
+        { return hash_each(k, [](const unsigned char* b, size_t c) { return size_t(jvn::crc32c::hash_software(b, c, 0)); }); });
+#endif
+    run(cfg, "jvn::hash", keys, [](const std::vector<std::string>& k)
+        { size_t sum = 0; for (auto& key : k) sum += jvn::hash<std::string>{}(key); return sum; });
+    run(cfg, "jvn::hash_bulk", keys, [](const std::vector<std::string>& k)
+        {
+            size_t hashes[1024];
+            auto end = jvn::hash_bulk(k.begin(), k.end(), hashes);
+            size_t sum = 0;
+            for (auto it = hashes; it != end; ++it)
+                sum += *it;
+            return sum;
+        });
+    run(cfg, "std::hash", keys, [](const std::vector<std::string>& k)
+        { size_t sum = 0; for (auto& key : k) sum += std::hash<std::string>{}(key); return sum; });
+}
+
+} // namespace bench
+
+int main(int argc, char** argv)
+{
+    bench::config cfg;
+    cfg.total_bytes = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 256000000u;
+    cfg.filter = argc > 2 ? argv[2] : nullptr;
+
+    std::printf("sse4.2: %s\n", jvn::cpu::current().sse42 ? "yes" : "no");
+    for (size_t length : { 4, 8, 12, 16, 20, 24, 32, 64, 128, 256, 512, 1024, 4096, 65536 })
+        bench::run_length(cfg, length);
+}
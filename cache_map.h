@@ -0,0 +1,177 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+
+namespace jvn
+{
+
+    // A snapshot of the counters of a cache_map, returned by cache_map::stats()
+    struct cache_stats
+    {
+        size_t size;
+        size_t max_size;
+        // Lookups by get(), a put() of a key that's already cached counts as a hit as well
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+    };
+
+    // A cache of at most max_size() elements on an unordered_map, evicting with the CLOCK policy.
+    // Every element has a reference bit, set by get() and put(), and the clock hand walks the
+    // slots of the table in order. Instead of evicting the element it points to a hand that finds
+    // the bit set clears it and moves on, so an element is only evicted if it wasn't used since
+    // the hand last passed it. A new element starts with the bit cleared, so the keys used once
+    // are evicted before the ones used again, like the probationary segment of a segmented LRU.
+
+    // get() and put() are a lookup of the map plus, for put() of a new key into a full cache, a
+    // hand that passes each element at most twice, O(1) amortized. The table is allocated for
+    // max_size() elements up front, so it never grows and the eviction is the backward shift
+    // of erase(). The reference bit is stored next to the value, setting it only writes to the
+    // slot the lookup has already read, and only if it wasn't set already.
+
+    // The pointers returned by get() are invalidated by the next put() or erase(). Not thread
+    // safe, not even get() since it sets the reference bit and counts the hits.
+    template <class Kt, class Vt, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout>
+        class cache_map
+    {
+        // The mapped value with its reference bit
+        struct entry
+        {
+            template <class... Args>
+            explicit entry(bool used, Args&&... args) :value(std::forward<Args>(args)...), referenced(used) {}
+
+            Vt value;
+            bool referenced;
+        };
+
+    public:
+        using map_type              = unordered_map<Kt, entry, Hasher, KeyEq,
+            typename std::allocator_traits<Alloc>::template rebind_alloc<pair<Kt, entry>>, Layout>;
+        using hasher                = Hasher;
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using size_type             = typename map_type::size_type;
+        using allocator_type        = Alloc;
+
+        explicit cache_map(size_type max_size, float load_factor = 0.75f, const hasher& hash = hasher(),
+            const key_equal& equal = key_equal(), const allocator_type& alloc = allocator_type())
+            :MAX_SIZE(max_size ? max_size : size_type(1)),
+            m_map(load_factor, 2u, 2u, hash, equal, typename map_type::allocator_type(alloc))
+        {
+            m_map.reserve(MAX_SIZE);
+        }
+
+        cache_map(const cache_map&) = delete;
+        cache_map& operator=(const cache_map&) = delete;
+
+        // Returns the cached value of the key and marks it used, or nullptr if it isn't cached
+        mapped_type* get(const key_type& key)
+        {
+            auto iter = m_map.find(key);
+            if (iter == m_map.end())
+            {
+                ++m_misses;
+                return nullptr;
+            }
+            ++m_hits;
+            return &use(iter->second);
+        }
+
+        // Caches the value of the key, evicting an element if the cache is full and the key is new.
+        // Returns whether the key is new
+        template <class M>
+        bool put(const key_type& key, M&& value)
+        {
+            // Only a full cache looks the key up before inserting it
+            if (m_map.size() >= MAX_SIZE)
+            {
+                auto iter = m_map.find(key);
+                if (iter != m_map.end())
+                {
+                    ++m_hits;
+                    use(iter->second) = std::forward<M>(value);
+                    return false;
+                }
+                evict();
+            }
+            // The value is left untouched if the key is found
+            auto result = m_map.emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(false, std::forward<M>(value)));
+            if (!result.second)
+            {
+                ++m_hits;
+                use(result.first->second) = std::forward<M>(value);
+            }
+            return result.second;
+        }
+
+        // Doesn't mark the key used or count as a lookup
+        bool contains(const key_type& key) const { return m_map.contains(key); }
+
+        size_type erase(const key_type& key) { return m_map.erase(key); }
+
+        size_type size() const noexcept { return m_map.size(); }
+        bool empty() const noexcept { return m_map.empty(); }
+        size_type max_size() const noexcept { return MAX_SIZE; }
+        hasher hash_function() const { return m_map.hash_function(); }
+        key_equal key_eq() const { return m_map.key_eq(); }
+
+        cache_stats stats() const noexcept
+        {
+            cache_stats result{};
+            result.size = m_map.size();
+            result.max_size = MAX_SIZE;
+            result.hits = m_hits;
+            result.misses = m_misses;
+            result.evictions = m_evictions;
+            return result;
+        }
+
+        void reset_stats() noexcept { m_hits = m_misses = m_evictions = 0; }
+
+    private:
+        const size_type MAX_SIZE;
+
+        map_type m_map;
+        // The slot the clock hand points to
+        size_type m_hand = 0;
+        size_type m_hits = 0, m_misses = 0, m_evictions = 0;
+
+        // Sets the reference bit, unless it's set already so a hot slot isn't written to on every hit
+        static mapped_type& use(entry& cached) noexcept
+        {
+            if (!cached.referenced)
+                cached.referenced = true;
+            return cached.value;
+        }
+
+        // Moves the hand to the first element without the reference bit, clearing the bits it
+        // passes, and erases it. The backward shift refills the slot, so the hand stays on it
+        void evict()
+        {
+            while (true)
+            {
+                m_hand = map_type::nextTaken(m_map.m_info_bucket, m_map.m_capacity, m_hand);
+                if (m_hand == m_map.m_capacity)
+                {
+                    m_hand = 0;
+                    continue;
+                }
+                auto& cached = m_map.bucket(m_hand)->second;
+                if (cached.referenced)
+                {
+                    cached.referenced = false;
+                    ++m_hand;
+                    continue;
+                }
+                m_map.erase(typename map_type::iterator(m_map.m_info_bucket, m_map.m_capacity, m_hand));
+                ++m_evictions;
+                return;
+            }
+        }
+    };
+
+} // namespace jvn
@@ -0,0 +1,580 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+// std::atomic
+#include <atomic>
+// std::shared_lock std::unique_lock
+#include <mutex>
+#include <shared_mutex>
+// std::this_thread::yield
+#include <thread>
+// std::remove_if
+#include <algorithm>
+#include <vector>
+
+namespace jvn
+{
+
+    // Allocates the storage of count objects of an over-aligned type, e.g. the cache line aligned
+    // shards, which std::allocator only aligns to max_align_t before C++17. The allocation has
+    // room to align the objects by hand, the byte in front of them holds how far they were moved
+    template <class Ty>
+    Ty* allocate_aligned(size_t count)
+    {
+        static_assert(alignof(Ty) <= 256, "The offset of the objects must fit in a byte");
+        auto raw = std::allocator<unsigned char>().allocate(count * sizeof(Ty) + alignof(Ty));
+        auto offset = alignof(Ty) - reinterpret_cast<uintptr_t>(raw) % alignof(Ty);
+        raw[offset - 1] = static_cast<unsigned char>(offset - 1);
+        return reinterpret_cast<Ty*>(raw + offset);
+    }
+
+    template <class Ty>
+    void deallocate_aligned(Ty* ptr, size_t count) noexcept
+    {
+        auto bytes = reinterpret_cast<unsigned char*>(ptr);
+        std::allocator<unsigned char>().deallocate(bytes - bytes[-1] - 1, count * sizeof(Ty) + alignof(Ty));
+    }
+
+    // A reader/writer spin lock for short critical sections, meets the SharedMutex requirements.
+    // The state holds the number of readers and a writer bit, a writer waits for the readers to leave.
+    class shared_spin_lock
+    {
+    public:
+        shared_spin_lock() noexcept : m_state(0) {}
+        shared_spin_lock(const shared_spin_lock&) = delete;
+        shared_spin_lock& operator=(const shared_spin_lock&) = delete;
+
+        void lock() noexcept
+        {
+            auto expected = uint32_t(0);
+            while (!m_state.compare_exchange_weak(expected, WRITER, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                expected = 0;
+                pause();
+            }
+        }
+        bool try_lock() noexcept
+        {
+            auto expected = uint32_t(0);
+            return m_state.compare_exchange_strong(expected, WRITER, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+        void unlock() noexcept { m_state.store(0, std::memory_order_release); }
+
+        void lock_shared() noexcept
+        {
+            while (!try_lock_shared())
+                // Spin on a load so the cache line isn't written to while the writer holds it
+                while (m_state.load(std::memory_order_relaxed) & WRITER)
+                    pause();
+        }
+        bool try_lock_shared() noexcept
+        {
+            if (!(m_state.fetch_add(1, std::memory_order_acquire) & WRITER))
+                return true;
+            m_state.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        void unlock_shared() noexcept { m_state.fetch_sub(1, std::memory_order_release); }
+
+    private:
+        static JVN_INLINE_VAR constexpr uint32_t WRITER = uint32_t(1) << 31;
+
+        std::atomic<uint32_t> m_state;
+
+        static void pause() noexcept
+        {
+#if JVN(SIMD) != JVN_SIMD_NONE
+            _mm_pause();
+#else
+            std::this_thread::yield();
+#endif
+        }
+    };
+
+#if JVN(CXX17)
+    using shared_mutex = std::shared_mutex;
+#else
+    using shared_mutex = std::shared_timed_mutex;
+#endif
+
+    // A thread safe hashmap made of unordered_map shards, each guarded by its own Mutex.
+    // The shard of a key is picked by the top bits of its hash passed through the murmur finalizer,
+    // so the hashes that only differ in their low bits, e.g. of identity_hash, are spread over the
+    // shards as well. The tables of the shards reduce the unmixed hash by their own Range, which
+    // doesn't depend on the shard. A shard grows on its own, so a grow() only stalls the threads
+    // accessing the same shard.
+
+    // Since an iterator or reference to an element is only valid while its shard is locked the
+    // elements are accessed by value or through the visit functions, which invoke a function
+    // object on the element while holding the lock. The function object must not access the map.
+
+    template <class Kt, class Vt, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout, class Mutex = shared_mutex>
+        class concurrent_map
+    {
+    public:
+        using map_type              = unordered_map<Kt, Vt, Hasher, KeyEq, Alloc, Layout>;
+        using hasher                = Hasher;
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = pair<Kt, Vt>;
+        using size_type             = typename map_type::size_type;
+        using allocator_type        = Alloc;
+        using mutex_type            = Mutex;
+
+        // The number of shards is rounded up to a power of two, the initial capacity is split between them.
+        // The other arguments are those of unordered_map, every shard gets a copy of them
+        explicit concurrent_map(size_type shard_count = 64u, float load_factor = 0.75f,
+            size_type inital_capacity = 8192u, size_type growth_factor = 2u, const hasher& hash = hasher(),
+            const key_equal& equal = key_equal(), const allocator_type& alloc = allocator_type())
+            :m_shard_count(closest_power_of_two(shard_count)),
+            m_shift(JVN(BITNESS) - countr_zero(uint32_t(m_shard_count))),
+            m_hasher(hash)
+        {
+            m_shards = allocate_aligned<shard>(m_shard_count);
+            size_type idx = 0;
+            try
+            {
+                for (; idx != m_shard_count; ++idx)
+                    ::new (m_shards + idx) shard(load_factor, inital_capacity / m_shard_count, growth_factor,
+                        hash, equal, alloc);
+            }
+            catch (...)
+            {
+                while (idx)
+                    m_shards[--idx].~shard();
+                deallocate_aligned(m_shards, m_shard_count);
+                throw;
+            }
+        }
+
+        concurrent_map(const concurrent_map&) = delete;
+        concurrent_map& operator=(const concurrent_map&) = delete;
+
+        ~concurrent_map()
+        {
+            for (size_type idx = 0; idx != m_shard_count; ++idx)
+                m_shards[idx].~shard();
+            deallocate_aligned(m_shards, m_shard_count);
+        }
+
+        // Returns true if the pair was inserted, false if the key was already in the map
+        template <class Ty, std::enable_if_t<std::is_same<std::decay_t<Ty>, value_type>::value, int> = 0>
+        bool insert(Ty&& key_value_pair)
+        {
+            auto hash = m_hasher(key_value_pair.first);
+            auto& s = shardOf(hash);
+            std::unique_lock<Mutex> lock(s.lock);
+            return s.table.emplaceHashed(hash, key_value_pair.first, std::forward<Ty>(key_value_pair)).second;
+        }
+
+        // Copies the mapped value into value if the key is found
+        bool find(const key_type& key, mapped_type& value) const
+        {
+            return cvisit(key, [&value](const value_type& key_value_pair) { value = key_value_pair.second; });
+        }
+
+        bool contains(const key_type& key) const
+        {
+            auto hash = m_hasher(key);
+            auto& s = shardOf(hash);
+            std::shared_lock<Mutex> lock(s.lock);
+            return s.table.lookup(key, hash) != s.table.end();
+        }
+
+        size_type erase(const key_type& key)
+        {
+            auto hash = m_hasher(key);
+            auto& s = shardOf(hash);
+            std::unique_lock<Mutex> lock(s.lock);
+            return s.table.eraseKey(key, hash);
+        }
+
+        // Invokes func(value_type&) on the element with the key under an exclusive lock,
+        // returns false if the key isn't found. The function object must not modify the key
+        template <class Func>
+        bool visit(const key_type& key, Func&& func)
+        {
+            auto hash = m_hasher(key);
+            auto& s = shardOf(hash);
+            std::unique_lock<Mutex> lock(s.lock);
+            auto iter = s.table.lookup(key, hash);
+            if (iter == s.table.end())
+                return false;
+            auto key_value_pair = iter.operator->();
+            func(*key_value_pair);
+            return true;
+        }
+
+        // Invokes func(const value_type&) on the element with the key under a shared lock,
+        // returns false if the key isn't found
+        template <class Func>
+        bool cvisit(const key_type& key, Func&& func) const
+        {
+            auto hash = m_hasher(key);
+            auto& s = shardOf(hash);
+            std::shared_lock<Mutex> lock(s.lock);
+            auto iter = s.table.lookup(key, hash);
+            if (iter == s.table.end())
+                return false;
+            func(*iter);
+            return true;
+        }
+
+        // Invokes func(const value_type&) on every element, one shard at a time under a shared lock.
+        // The elements inserted or erased concurrently may or may not be visited
+        template <class Func>
+        void cvisit_all(Func&& func) const
+        {
+            for (size_type idx = 0; idx != m_shard_count; ++idx)
+            {
+                std::shared_lock<Mutex> lock(m_shards[idx].lock);
+                for (auto& key_value_pair : m_shards[idx].table)
+                    func(key_value_pair);
+            }
+        }
+
+        // The sum of the shard sizes, only exact if there are no concurrent modifications
+        size_type size() const
+        {
+            auto count = size_type(0);
+            for (size_type idx = 0; idx != m_shard_count; ++idx)
+            {
+                std::shared_lock<Mutex> lock(m_shards[idx].lock);
+                count += m_shards[idx].table.size();
+            }
+            return count;
+        }
+        bool empty() const { return !size(); }
+
+        size_type shard_count() const noexcept { return m_shard_count; }
+
+    private:
+        // Shards are cache line aligned so the locks of neighbouring shards don't share a line
+        struct alignas(64) shard
+        {
+            shard(float load_factor, size_type inital_capacity, size_type growth_factor, const hasher& hash,
+                const key_equal& equal, const allocator_type& alloc)
+                :table(load_factor, inital_capacity, growth_factor, hash, equal, alloc) {}
+
+            mutable Mutex lock;
+            map_type table;
+        };
+
+        const size_type m_shard_count;
+        // Shifts the mixed hash so only the bits selecting the shard remain
+        const int m_shift;
+        shard* m_shards;
+        // Hashes every key once, the hash picks the shard and is passed on to the shard's table.
+        // The tables hold copies of it, so a seeded_hash has the same seed in every shard
+        hasher m_hasher;
+
+        shard& shardOf(size_t hash) const noexcept { return m_shards[murmur_hash::finalize(hash) >> m_shift]; }
+    };
+
+    // A small index of the calling thread, unique among the live threads. The index of a thread
+    // that exited is given to the next new thread, so the indices stay below the peak thread count
+    inline size_t thread_index()
+    {
+        struct registry
+        {
+            std::mutex lock;
+            std::vector<size_t> free;
+            size_t next = 0;
+        };
+        static registry threads;
+
+        struct holder
+        {
+            holder()
+            {
+                std::lock_guard<std::mutex> guard(threads.lock);
+                if (threads.free.empty())
+                    index = threads.next++;
+                else
+                {
+                    index = threads.free.back();
+                    threads.free.pop_back();
+                }
+            }
+            ~holder()
+            {
+                std::lock_guard<std::mutex> guard(threads.lock);
+                threads.free.push_back(index);
+            }
+            size_t index;
+        };
+        thread_local holder current;
+        return current.index;
+    }
+
+    // A map for read mostly data, e.g. routing tables, looked up by many threads and updated rarely.
+    // The readers look up an immutable unordered_map without locks, a writer copies the table,
+    // applies a batch of changes to the copy and publishes it with a single store. A replaced table
+    // is freed once no reader holds it.
+
+    // The tables are reclaimed with hazard pointers. A reader stores the table it's about to read in
+    // a hazard slot and checks it's still the published one after a fence. A writer frees the
+    // replaced tables that no slot holds after the next update, it never waits for the readers.
+    // The lookups use the cache line aligned slot of their thread, picked by thread_index(), without
+    // atomic read-modify-writes. A snapshot and the threads past MAX_READERS take a slot of their own
+    // from a list shared by the threads instead, a compare-exchange on a slot nobody else holds.
+
+    // An update copies the whole table, O(size()), so the changes should be batched. A snapshot pins
+    // one table for any number of lookups, a consistent view that also amortizes the fence.
+    // The slot of a snapshot isn't tied to a thread, it may be moved to and destroyed by another one.
+    template <class Kt, class Vt, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout>
+        class snapshot_map
+    {
+        struct hazard;
+
+    public:
+        using map_type              = unordered_map<Kt, Vt, Hasher, KeyEq, Alloc, Layout>;
+        using hasher                = Hasher;
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = pair<Kt, Vt>;
+        using size_type             = typename map_type::size_type;
+        using allocator_type        = Alloc;
+
+        // A published table pinned for reading, it stays valid until the snapshot is destroyed
+        class snapshot
+        {
+        public:
+            snapshot(snapshot&& other) noexcept :m_slot(other.m_slot), m_table(other.m_table) { other.m_slot = nullptr; }
+            snapshot(const snapshot&) = delete;
+            snapshot& operator=(const snapshot&) = delete;
+            ~snapshot()
+            {
+                if (m_slot)
+                    snapshot_map::release(m_slot);
+            }
+
+            const map_type& operator*() const noexcept { return *m_table; }
+            const map_type* operator->() const noexcept { return m_table; }
+
+        private:
+            friend class snapshot_map;
+            snapshot(hazard* slot, const map_type* table) noexcept :m_slot(slot), m_table(table) {}
+
+            hazard* m_slot;
+            const map_type* m_table;
+        };
+
+        explicit snapshot_map(float load_factor = 0.75f, size_type inital_capacity = 128u, size_type growth_factor = 16u,
+            const hasher& hash = hasher(), const key_equal& equal = key_equal(), const allocator_type& alloc = allocator_type())
+            :m_growth_factor(growth_factor),
+            m_current(new map_type(load_factor, inital_capacity, growth_factor, hash, equal, alloc))
+        {}
+
+        snapshot_map(const snapshot_map&) = delete;
+        snapshot_map& operator=(const snapshot_map&) = delete;
+
+        // No reader may be left
+        ~snapshot_map()
+        {
+            delete m_current.load(std::memory_order_relaxed);
+            for (auto table : m_retired)
+                delete table;
+            for (auto slot = m_hazards.load(std::memory_order_relaxed); slot;)
+            {
+                auto next = slot->next;
+                slot->~hazard();
+                deallocate_aligned(slot, 1);
+                slot = next;
+            }
+        }
+
+        snapshot get_snapshot() const
+        {
+            auto slot = acquire();
+            return snapshot(slot, protect(slot->table));
+        }
+
+        // Copies the mapped value into value if the key is found
+        bool find(const key_type& key, mapped_type& value) const
+        {
+            return cvisit(key, [&value](const value_type& key_value_pair) { value = key_value_pair.second; });
+        }
+
+        bool contains(const key_type& key) const
+        {
+            pin_guard pin(*this);
+            return pin.table->contains(key);
+        }
+
+        // Invokes func(const value_type&) on the element with the key, returns false if the key isn't found
+        template <class Func>
+        bool cvisit(const key_type& key, Func&& func) const
+        {
+            pin_guard pin(*this);
+            auto iter = pin.table->find(key);
+            if (iter == pin.table->end())
+                return false;
+            func(*iter);
+            return true;
+        }
+
+        size_type size() const
+        {
+            pin_guard pin(*this);
+            return pin.table->size();
+        }
+        bool empty() const { return !size(); }
+
+        // Applies func(map_type&) to a copy of the published table and publishes the copy.
+        // The updates are serialized, the readers see either all of the changes or none of them
+        template <class Func>
+        void update(Func&& func)
+        {
+            std::lock_guard<std::mutex> lock(m_write_lock);
+            auto current = m_current.load(std::memory_order_relaxed);
+            std::unique_ptr<map_type> next(new map_type(current->max_load_factor(), current->bucket_count(),
+                m_growth_factor, current->hash_function(), current->key_eq(), current->get_allocator()));
+            for (auto& key_value_pair : *current)
+                next->insert(key_value_pair);
+            func(*next);
+
+            m_retired.reserve(m_retired.size() + 1);
+            m_current.store(next.release(), std::memory_order_release);
+            m_retired.push_back(current);
+            reclaim();
+        }
+
+        // Frees the replaced tables no reader holds anymore, done by every update() as well
+        void reclaim_retired()
+        {
+            std::lock_guard<std::mutex> lock(m_write_lock);
+            reclaim();
+        }
+
+    private:
+        // Threads with a greater thread_index() take a shared slot for their lookups
+        static JVN_INLINE_VAR constexpr size_t MAX_READERS = 128;
+
+        // The hazard pointer of a reader thread, depth counts its nested pins
+        struct alignas(64) reader
+        {
+            std::atomic<const map_type*> table{ nullptr };
+            size_t depth = 0;
+        };
+
+        // A hazard pointer of the shared list, held by whoever set taken. The slots are only freed
+        // with the map, so the list is never unlinked while it's walked
+        struct alignas(64) hazard
+        {
+            std::atomic<const map_type*> table{ nullptr };
+            std::atomic<bool> taken{ true };
+            hazard* next = nullptr;
+        };
+
+        // Pins the table of a lookup until the end of the scope
+        struct pin_guard
+        {
+            explicit pin_guard(const snapshot_map& map)
+            {
+                auto idx = thread_index();
+                if (idx >= MAX_READERS)
+                {
+                    slot = map.acquire();
+                    table = map.protect(slot->table);
+                    return;
+                }
+                local = &map.m_readers[idx];
+                // A nested lookup, e.g. from the function of cvisit, reuses the pinned table
+                table = local->depth++ ? local->table.load(std::memory_order_relaxed) : map.protect(local->table);
+            }
+            pin_guard(const pin_guard&) = delete;
+            pin_guard& operator=(const pin_guard&) = delete;
+            ~pin_guard()
+            {
+                if (slot)
+                    release(slot);
+                else if (!--local->depth)
+                    local->table.store(nullptr, std::memory_order_release);
+            }
+
+            reader* local = nullptr;
+            hazard* slot = nullptr;
+            const map_type* table;
+        };
+
+        const size_type m_growth_factor;
+        std::atomic<map_type*> m_current;
+        mutable reader m_readers[MAX_READERS];
+        // The shared slots, pushed at the head and never removed
+        mutable std::atomic<hazard*> m_hazards{ nullptr };
+        // Guards m_retired and serializes the writers
+        std::mutex m_write_lock;
+        std::vector<map_type*> m_retired;
+
+        // Stores the published table in slot, returns it once it's still the published one after
+        // the store. The table stays valid until the slot is cleared
+        const map_type* protect(std::atomic<const map_type*>& slot) const noexcept
+        {
+            const map_type* table = m_current.load(std::memory_order_acquire);
+            while (true)
+            {
+                slot.store(table, std::memory_order_relaxed);
+                // Orders the store before the load below, pairs with the fence of reclaim()
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const map_type* published = m_current.load(std::memory_order_acquire);
+                if (published == table)
+                    return table;
+                table = published;
+            }
+        }
+
+        // Takes a free slot of the shared list, or pushes a new one if all of them are taken
+        hazard* acquire() const
+        {
+            for (auto slot = m_hazards.load(std::memory_order_acquire); slot; slot = slot->next)
+            {
+                auto expected = false;
+                if (!slot->taken.load(std::memory_order_relaxed) &&
+                    slot->taken.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed))
+                    return slot;
+            }
+            auto slot = ::new (allocate_aligned<hazard>(1)) hazard();
+            slot->next = m_hazards.load(std::memory_order_relaxed);
+            while (!m_hazards.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed));
+            return slot;
+        }
+
+        static void release(hazard* slot) noexcept
+        {
+            slot->table.store(nullptr, std::memory_order_release);
+            slot->taken.store(false, std::memory_order_release);
+        }
+
+        // The writer lock is held
+        void reclaim()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto head = m_hazards.load(std::memory_order_acquire);
+            auto held = [this, head](const map_type* table)
+            {
+                for (auto& slot : m_readers)
+                    if (slot.table.load(std::memory_order_acquire) == table)
+                        return true;
+                for (auto slot = head; slot; slot = slot->next)
+                    if (slot->table.load(std::memory_order_acquire) == table)
+                        return true;
+                return false;
+            };
+            m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), [&held](map_type* table)
+            {
+                if (held(table))
+                    return false;
+                delete table;
+                return true;
+            }), m_retired.end());
+        }
+    };
+
+} // namespace jvn
@@ -1,251 +1,1023 @@
-#pragma once
-#include <string>
-// Types and limits e.g. SIZE_MAX UINT64_MAX
-#include <stdint.h>
-
-// Define custom macro  --------------------------------
-
-#define JVN(x) JVN_DEFINITION_##x()
-
-// inline variables
-// Check if C++17 or greater
-#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L))
-#   define JVN_INLINE_VAR inline
-#else
-#   define JVN_INLINE_VAR
-#endif
-
-// bitness
-#if SIZE_MAX == UINT64_MAX
-#    define JVN_DEFINITION_BITNESS() 64
-#elif SIZE_MAX == UINT32_MAX
-#    define JVN_DEFINITION_BITNESS() 32
-#else
-#    error Unsupported bitness
-#endif
-
-// likely/unlikely
-#ifdef _MSC_VER
-#    define JVN_LIKELY(condition) condition
-#    define JVN_UNLIKELY(condition) condition
-#else
-#    define JVN_LIKELY(condition) __builtin_expect(condition, 1)
-#    define JVN_UNLIKELY(condition) __builtin_expect(condition, 0)
-#endif
-
-// End custom macro  -----------------------------------
-
-namespace jvn
-{
-
-// FNV-1a hash algorithm
-namespace fnv
-{
-
-// FNV-1a utility
-#if JVN(BITNESS) == 64
-    JVN_INLINE_VAR constexpr size_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
-    JVN_INLINE_VAR constexpr size_t FNV_PRIME        = 1099511628211ULL;
-#else
-    JVN_INLINE_VAR constexpr size_t FNV_OFFSET_BASIS = 2166136261U;
-    JVN_INLINE_VAR constexpr size_t FNV_PRIME        = 16777619U;
-#endif
-    
-inline size_t fnv_1a(size_t val, const unsigned char* bytes, size_t count) noexcept
-{
-    for (size_t i = 0; i < count; ++i)
-    {
-        val ^= bytes[i];
-        val *= FNV_PRIME;
-    }
-    return val;
-}
-} // namespace fnv
-
-// MurmurHash hash algorithm
-namespace murmur_hash
-{
-
-// Seed for MurmurHash64A and MurmurHashNeutral2
-JVN_INLINE_VAR constexpr size_t SEED = 0xe17a1465;
-
-#if JVN(BITNESS) == 64
-
-    //  TODO : Check if endian dependent
-    //  MurmurHash64A
-    JVN_INLINE_VAR constexpr size_t m = 0xc6a4a7935bd1e995;
-    JVN_INLINE_VAR constexpr size_t r = 47;
-    size_t murmur_hash2(const unsigned char* bytes, size_t count) noexcept
-    {
-        size_t hash = SEED ^ (count * m);
-
-        const size_t* data = reinterpret_cast<const size_t*>(bytes);
-        const size_t* end = data + (count / 8);
-
-        while(data != end)
-        {
-            size_t k = *data++;
-
-            k *= m; 
-            k ^= k >> r; 
-            k *= m; 
-            
-            hash ^= k;
-            hash *= m; 
-        }
-
-        const unsigned char* data2 = reinterpret_cast<const unsigned char*>(data);
-
-        switch(count & 7)
-        {
-        case 7: hash ^= size_t(data2[6]) << 48;
-        case 6: hash ^= size_t(data2[5]) << 40;
-        case 5: hash ^= size_t(data2[4]) << 32;
-        case 4: hash ^= size_t(data2[3]) << 24;
-        case 3: hash ^= size_t(data2[2]) << 16;
-        case 2: hash ^= size_t(data2[1]) << 8;
-        case 1: hash ^= size_t(data2[0]);
-                hash *= m;
-        };
-    
-        hash ^= hash >> r;
-        hash *= m;
-        hash ^= hash >> r;
-
-        return hash;
-    } 
-
-    // MurmurHash3 Int64 mix
-    inline size_t murmur_hash3_int(size_t k) noexcept
-    {
-        k ^= k >> 33;
-        k *= 0xff51afd7ed558ccd;
-        k ^= k >> 33;
-        k *= 0xc4ceb9fe1a85ec53;
-        k ^= k >> 33;
-        return k;
-    }
-
-#else
-
-    // MurmurHashNeutral2
-    JVN_INLINE_VAR constexpr size_t m = 0x5bd1e995;
-    JVN_INLINE_VAR constexpr size_t r = 24;
-    size_t murmur_hash2(const unsigned char* bytes, size_t count) noexcept
-    {
-        size_t hash = SEED ^ count;
-
-        while(count >= 4)
-        {
-            size_t k;
-
-            k  = bytes[0];
-            k |= bytes[1] << 8;
-            k |= bytes[2] << 16;
-            k |= bytes[3] << 24;
-
-            k *= m; 
-            k ^= k >> r; 
-            k *= m;
-
-            hash *= m;
-            hash ^= k;
-
-            bytes += 4;
-            count -= 4;
-        }
-        
-        switch(count)
-        {
-        case 3: hash ^= bytes[2] << 16;
-        case 2: hash ^= bytes[1] << 8;
-        case 1: hash ^= bytes[0];
-                hash *= m;
-        };
-
-        hash ^= hash >> 13;
-        hash *= m;
-        hash ^= hash >> 15;
-
-        return hash;
-    } 
-
-    // MurmurHash3 Int32 mix
-    inline size_t murmur_hash3_int(size_t h) noexcept
-    {
-        h ^= h >> 16;
-        h *= 0x85ebca6b;
-        h ^= h >> 13;
-        h *= 0xc2b2ae35;
-        h ^= h >> 16;
-        return h;
-    }
-
-#endif
-
-} // namespace murmur_hash
-
-
-// A function object that returns the hash of Kt type
-// By default it uses the MurmurHash2/3 algorithm
-// There is also an FNV-1a implementation fnv::fnv_1a(...)
-template <class Kt>
-struct hash
-{
-    // General byte hashing
-    size_t operator()(const Kt& key) const noexcept
-    {
-        return murmur_hash::murmur_hash2(&reinterpret_cast<const unsigned char&>(key), sizeof(key));
-    }
-};
-
-
-// Type specialization
-
-// There's probably a better way with SFINAE or some other conditional
-// enabling. But this is a pretty easy way to do specific specialization
-#define JVN_HASH_INT(Ty)                                        \
-    template <>                                                 \
-    struct hash<Ty>                                             \
-    {                                                           \
-        size_t operator()(const Ty key) const noexcept          \
-        {                                                       \
-            return murmur_hash::murmur_hash3_int(size_t(key));  \
-        }                                                       \
-    }                                                           
-
-JVN_HASH_INT(bool);
-JVN_HASH_INT(char);
-JVN_HASH_INT(signed char);
-JVN_HASH_INT(unsigned char);
-JVN_HASH_INT(char16_t);
-JVN_HASH_INT(char32_t);
-JVN_HASH_INT(wchar_t);
-JVN_HASH_INT(short);
-JVN_HASH_INT(unsigned short);
-JVN_HASH_INT(int);
-JVN_HASH_INT(unsigned int);
-JVN_HASH_INT(long);
-JVN_HASH_INT(long long);
-JVN_HASH_INT(unsigned long);
-JVN_HASH_INT(unsigned long long);
-
-template <class Ty>
-struct hash<Ty*> {
-    size_t operator()(Ty* ptr) const noexcept
-    {
-        return murmur_hash::murmur_hash3_int(size_t(ptr));
-    }
-};
-
-template <>
-struct hash<std::string>
-{
-    size_t operator()(const std::string& str) const noexcept
-    {
-        return murmur_hash::murmur_hash2(
-            reinterpret_cast<const unsigned char*>(str.data()), str.size());
-    }
-};
-
+#pragma once
+#include "utility.h"
+#include <string>
+// Types and limits e.g. SIZE_MAX UINT64_MAX
+#include <stdint.h>
+// strlen
+#include <cstring>
+// std::mt19937_64 std::random_device
+#include <random>
+// std::iterator_traits
+#include <iterator>
+// std::tuple std::array, composite keys
+#include <tuple>
+#include <array>
+#include <initializer_list>
+
+// Define custom macro  --------------------------------
+
+#define JVN(x) JVN_DEFINITION_##x()
+
+// inline variables
+// Check if C++17 or greater
+#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L))
+#   define JVN_DEFINITION_CXX17() 1
+#   define JVN_INLINE_VAR inline
+#else
+#   define JVN_DEFINITION_CXX17() 0
+#   define JVN_INLINE_VAR
+#endif
+
+// bitness
+#if SIZE_MAX == UINT64_MAX
+#    define JVN_DEFINITION_BITNESS() 64
+#elif SIZE_MAX == UINT32_MAX
+#    define JVN_DEFINITION_BITNESS() 32
+#else
+#    error Unsupported bitness
+#endif
+
+// likely/unlikely
+#ifdef _MSC_VER
+#    define JVN_LIKELY(condition) condition
+#    define JVN_UNLIKELY(condition) condition
+#else
+#    define JVN_LIKELY(condition) __builtin_expect(condition, 1)
+#    define JVN_UNLIKELY(condition) __builtin_expect(condition, 0)
+#endif
+
+// SIMD instruction set available at compile time
+#define JVN_SIMD_NONE 0
+#define JVN_SIMD_SSE2 1
+#define JVN_SIMD_AVX2 2
+#if defined(__AVX2__)
+#    define JVN_DEFINITION_SIMD() JVN_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define JVN_DEFINITION_SIMD() JVN_SIMD_SSE2
+#else
+#    define JVN_DEFINITION_SIMD() JVN_SIMD_NONE
+#endif
+
+// prefetch into all cache levels for reading
+#ifndef _MSC_VER
+#    define JVN_PREFETCH(ptr) __builtin_prefetch(ptr)
+#elif JVN(SIMD) != JVN_SIMD_NONE
+#    define JVN_PREFETCH(ptr) _mm_prefetch(reinterpret_cast<const char*>(ptr), _MM_HINT_T0)
+#else
+#    define JVN_PREFETCH(ptr) ((void)(ptr))
+#endif
+
+// x86-64, the instruction set extensions beyond SSE2 are detected at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#    define JVN_DEFINITION_X64() 1
+#else
+#    define JVN_DEFINITION_X64() 0
+#endif
+
+// compiles a function for an instruction set extension, it's only called after a runtime check
+#ifdef _MSC_VER
+#    define JVN_TARGET(isa)
+#else
+#    define JVN_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// End custom macro  -----------------------------------
+
+#if JVN(CXX17)
+// std::string_view
+#   include <string_view>
+#endif
+
+#if JVN(X64)
+// _mm_crc32_u64 __cpuid _umul128
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#       include <nmmintrin.h>
+#   endif
+#endif
+
+namespace jvn
+{
+
+// FNV-1a hash algorithm
+namespace fnv
+{
+
+// FNV-1a utility
+#if JVN(BITNESS) == 64
+    JVN_INLINE_VAR constexpr size_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    JVN_INLINE_VAR constexpr size_t FNV_PRIME        = 1099511628211ULL;
+#else
+    JVN_INLINE_VAR constexpr size_t FNV_OFFSET_BASIS = 2166136261U;
+    JVN_INLINE_VAR constexpr size_t FNV_PRIME        = 16777619U;
+#endif
+    
+inline size_t fnv_1a(size_t val, const unsigned char* bytes, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        val ^= bytes[i];
+        val *= FNV_PRIME;
+    }
+    return val;
+}
+} // namespace fnv
+
+// MurmurHash hash algorithm
+namespace murmur_hash
+{
+
+// Seed for MurmurHash64A and MurmurHashNeutral2
+JVN_INLINE_VAR constexpr size_t SEED = 0xe17a1465;
+
+#if JVN(BITNESS) == 64
+
+    //  TODO : Check if endian dependent
+    //  MurmurHash64A
+    JVN_INLINE_VAR constexpr size_t m = 0xc6a4a7935bd1e995;
+    JVN_INLINE_VAR constexpr size_t r = 47;
+    inline size_t murmur_hash2(const unsigned char* bytes, size_t count, size_t seed = SEED) noexcept
+    {
+        size_t hash = seed ^ (count * m);
+
+        const size_t* data = reinterpret_cast<const size_t*>(bytes);
+        const size_t* end = data + (count / 8);
+
+        while(data != end)
+        {
+            size_t k = *data++;
+
+            k *= m; 
+            k ^= k >> r; 
+            k *= m; 
+            
+            hash ^= k;
+            hash *= m; 
+        }
+
+        const unsigned char* data2 = reinterpret_cast<const unsigned char*>(data);
+
+        switch(count & 7)
+        {
+        case 7: hash ^= size_t(data2[6]) << 48;
+        case 6: hash ^= size_t(data2[5]) << 40;
+        case 5: hash ^= size_t(data2[4]) << 32;
+        case 4: hash ^= size_t(data2[3]) << 24;
+        case 3: hash ^= size_t(data2[2]) << 16;
+        case 2: hash ^= size_t(data2[1]) << 8;
+        case 1: hash ^= size_t(data2[0]);
+                hash *= m;
+        };
+    
+        hash ^= hash >> r;
+        hash *= m;
+        hash ^= hash >> r;
+
+        return hash;
+    } 
+
+    // The step of MurmurHash64A consuming a word and its final mix, for hashing a sequence of
+    // words that aren't contiguous in memory, e.g. the members of a composite key
+    constexpr size_t absorb(size_t hash, size_t k) noexcept
+    {
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        hash ^= k;
+        hash *= m;
+        return hash;
+    }
+    constexpr size_t finalize(size_t hash) noexcept
+    {
+        hash ^= hash >> r;
+        hash *= m;
+        hash ^= hash >> r;
+        return hash;
+    }
+
+    // MurmurHash3 Int64 mix
+    constexpr size_t murmur_hash3_int(size_t k) noexcept
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccd;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53;
+        k ^= k >> 33;
+        return k;
+    }
+
+#else
+
+    // MurmurHashNeutral2
+    JVN_INLINE_VAR constexpr size_t m = 0x5bd1e995;
+    JVN_INLINE_VAR constexpr size_t r = 24;
+    // Reads the input byte by byte, Byte is char or unsigned char so it can run at compile time
+    template <class Byte>
+    constexpr size_t murmur_hash2(const Byte* bytes, size_t count, size_t seed = SEED) noexcept
+    {
+        size_t hash = seed ^ count;
+
+        while(count >= 4)
+        {
+            size_t k = 0;
+
+            k  = uint8_t(bytes[0]);
+            k |= size_t(uint8_t(bytes[1])) << 8;
+            k |= size_t(uint8_t(bytes[2])) << 16;
+            k |= size_t(uint8_t(bytes[3])) << 24;
+
+            k *= m; 
+            k ^= k >> r; 
+            k *= m;
+
+            hash *= m;
+            hash ^= k;
+
+            bytes += 4;
+            count -= 4;
+        }
+        
+        switch(count)
+        {
+        case 3: hash ^= size_t(uint8_t(bytes[2])) << 16;
+        case 2: hash ^= size_t(uint8_t(bytes[1])) << 8;
+        case 1: hash ^= uint8_t(bytes[0]);
+                hash *= m;
+        };
+
+        hash ^= hash >> 13;
+        hash *= m;
+        hash ^= hash >> 15;
+
+        return hash;
+    } 
+
+    // The step of MurmurHashNeutral2 consuming a word and its final mix, for hashing a sequence of
+    // words that aren't contiguous in memory, e.g. the members of a composite key
+    constexpr size_t absorb(size_t hash, size_t k) noexcept
+    {
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        hash *= m;
+        hash ^= k;
+        return hash;
+    }
+    constexpr size_t finalize(size_t hash) noexcept
+    {
+        hash ^= hash >> 13;
+        hash *= m;
+        hash ^= hash >> 15;
+        return hash;
+    }
+
+    // MurmurHash3 Int32 mix
+    constexpr size_t murmur_hash3_int(size_t h) noexcept
+    {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+#endif
+
+} // namespace murmur_hash
+
+// Runtime CPU feature detection. A hash that uses an instruction set extension checks for it
+// once and otherwise falls back to a portable implementation returning the same values,
+// so the hashes don't depend on the machine
+namespace cpu
+{
+
+struct features
+{
+    bool sse42 = false;
+};
+
+inline features detect() noexcept
+{
+    features result;
+#if JVN(X64)
+#   ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    result.sse42 = (regs[2] >> 20) & 1;
+#   else
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        result.sse42 = (ecx >> 20) & 1;
+#   endif
+#endif
+    return result;
+}
+
+// The features of the executing CPU, detected on the first call
+inline const features& current() noexcept
+{
+    static const features result = detect();
+    return result;
+}
+
+} // namespace cpu
+
+#if JVN(BITNESS) == 64
+
+// wyhash (final version 4), the default hash of strings longer than 16 bytes.
+// A 64x64 -> 128 bit multiplication mixes 16 bytes at once and the inputs up to 16 bytes are
+// read with at most four overlapping loads, long inputs are consumed 48 bytes at a time in
+// three independent lanes
+namespace wyhash
+{
+
+JVN_INLINE_VAR constexpr uint64_t SECRET[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL };
+
+// Unaligned little endian reads, assembled from bytes so they can run at compile time,
+// the compilers merge them into a single load. Byte is char or unsigned char
+template <class Byte>
+constexpr uint64_t read8(const Byte* bytes) noexcept
+{
+    return uint64_t(uint8_t(bytes[0]))       | uint64_t(uint8_t(bytes[1])) << 8  |
+           uint64_t(uint8_t(bytes[2])) << 16 | uint64_t(uint8_t(bytes[3])) << 24 |
+           uint64_t(uint8_t(bytes[4])) << 32 | uint64_t(uint8_t(bytes[5])) << 40 |
+           uint64_t(uint8_t(bytes[6])) << 48 | uint64_t(uint8_t(bytes[7])) << 56;
+}
+template <class Byte>
+constexpr uint64_t read4(const Byte* bytes) noexcept
+{
+    return uint64_t(uint8_t(bytes[0]))       | uint64_t(uint8_t(bytes[1])) << 8  |
+           uint64_t(uint8_t(bytes[2])) << 16 | uint64_t(uint8_t(bytes[3])) << 24;
+}
+// 1 to 3 bytes, the first, the middle and the last one
+template <class Byte>
+constexpr uint64_t read3(const Byte* bytes, size_t count) noexcept
+{
+    return uint64_t(uint8_t(bytes[0])) << 16 | uint64_t(uint8_t(bytes[count >> 1])) << 8 | uint8_t(bytes[count - 1]);
+}
+
+// a:b = a * b
+constexpr void multiply(uint64_t& a, uint64_t& b) noexcept
+{
+#ifdef _MSC_VER
+    // _umul128 isn't constexpr, the product is assembled from the 32-bit halves
+    auto lo_lo = (a & 0xffffffff) * (b & 0xffffffff);
+    auto hi_lo = (a >> 32) * (b & 0xffffffff);
+    auto lo_hi = (a & 0xffffffff) * (b >> 32);
+    auto hi_hi = (a >> 32) * (b >> 32);
+    auto cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    a = (cross << 32) | (lo_lo & 0xffffffff);
+    b = hi_hi + (hi_lo >> 32) + (cross >> 32);
+#else
+    __extension__ using uint128 = unsigned __int128;
+    auto product = uint128(a) * b;
+    a = uint64_t(product);
+    b = uint64_t(product >> 64);
+#endif
+}
+
+constexpr uint64_t mix(uint64_t a, uint64_t b) noexcept
+{
+    multiply(a, b);
+    return a ^ b;
+}
+
+template <class Byte>
+constexpr uint64_t wyhash(const Byte* bytes, size_t count, uint64_t seed = 0) noexcept
+{
+    seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+    uint64_t a = 0, b = 0;
+    if (JVN_LIKELY(count <= 16))
+    {
+        if (JVN_LIKELY(count >= 4))
+        {
+            a = read4(bytes) << 32 | read4(bytes + ((count >> 3) << 2));
+            b = read4(bytes + count - 4) << 32 | read4(bytes + count - 4 - ((count >> 3) << 2));
+        }
+        else if (JVN_LIKELY(count > 0))
+            a = read3(bytes, count);
+    }
+    else
+    {
+        auto left = count;
+        if (JVN_UNLIKELY(left > 48))
+        {
+            auto seed1 = seed, seed2 = seed;
+            do
+            {
+                seed = mix(read8(bytes) ^ SECRET[1], read8(bytes + 8) ^ seed);
+                seed1 = mix(read8(bytes + 16) ^ SECRET[2], read8(bytes + 24) ^ seed1);
+                seed2 = mix(read8(bytes + 32) ^ SECRET[3], read8(bytes + 40) ^ seed2);
+                bytes += 48;
+                left -= 48;
+            } while (JVN_LIKELY(left > 48));
+            seed ^= seed1 ^ seed2;
+        }
+        while (JVN_UNLIKELY(left > 16))
+        {
+            seed = mix(read8(bytes) ^ SECRET[1], read8(bytes + 8) ^ seed);
+            bytes += 16;
+            left -= 16;
+        }
+        // The last 16 bytes, overlapping the ones already mixed
+        a = read8(bytes + left - 16);
+        b = read8(bytes + left - 8);
+    }
+    a ^= SECRET[1];
+    b ^= seed;
+    multiply(a, b);
+    return mix(a ^ SECRET[0] ^ count, b ^ SECRET[1]);
+}
+
+} // namespace wyhash
+
+// A hash built on the CRC32C instruction of SSE4.2.
+// The instruction has a latency of 3 cycles and a throughput of 1, so the input is consumed
+// 24 bytes at a time by three independent CRCs. CRC is linear, so the three are combined and
+// mixed by the MurmurHash3 finalizer. Without SSE4.2 a table driven CRC computes the same values.
+// Keys up to 8 bytes only go through one of the CRCs, it's meant for long keys
+namespace crc32c
+{
+
+// The reflected Castagnoli polynomial
+JVN_INLINE_VAR constexpr uint32_t POLYNOMIAL = 0x82f63b78;
+
+struct table
+{
+    table() noexcept
+    {
+        for (uint32_t idx = 0; idx < 256; ++idx)
+        {
+            auto crc = idx;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (POLYNOMIAL & (0 - (crc & 1)));
+            entries[idx] = crc;
+        }
+    }
+
+    static const table& instance() noexcept
+    {
+        static const table result;
+        return result;
+    }
+
+    uint32_t entries[256];
+};
+
+// The software equivalents of _mm_crc32_u8 and _mm_crc32_u64
+inline uint32_t update(const table& t, uint32_t crc, uint8_t byte) noexcept
+{
+    return t.entries[(crc ^ byte) & 0xff] ^ (crc >> 8);
+}
+inline uint32_t update(const table& t, uint32_t crc, uint64_t word) noexcept
+{
+    for (int idx = 0; idx < 8; ++idx, word >>= 8)
+        crc = update(t, crc, uint8_t(word));
+    return crc;
+}
+
+inline uint64_t finish(uint32_t crc0, uint32_t crc1, uint32_t crc2, size_t count) noexcept
+{
+    return murmur_hash::murmur_hash3_int((uint64_t(crc0) << 32 | crc1) ^ (uint64_t(crc2) * murmur_hash::m) ^ count);
+}
+
+// The three CRCs start from different values so equal blocks in different lanes don't cancel out
+#define JVN_CRC32C_HASH(update8, update1)                                           \
+    auto crc0 = uint32_t(seed), crc1 = uint32_t(seed >> 32), crc2 = ~uint32_t(seed); \
+    auto end = bytes + count;                                                       \
+    for (; end - bytes >= 24; bytes += 24)                                          \
+    {                                                                               \
+        crc0 = update8(crc0, wyhash::read8(bytes));                                 \
+        crc1 = update8(crc1, wyhash::read8(bytes + 8));                             \
+        crc2 = update8(crc2, wyhash::read8(bytes + 16));                            \
+    }                                                                               \
+    if (end - bytes >= 8)                                                           \
+    {                                                                               \
+        crc0 = update8(crc0, wyhash::read8(bytes));                                 \
+        bytes += 8;                                                                 \
+    }                                                                               \
+    if (end - bytes >= 8)                                                           \
+    {                                                                               \
+        crc1 = update8(crc1, wyhash::read8(bytes));                                 \
+        bytes += 8;                                                                 \
+    }                                                                               \
+    /* The last bytes are read overlapping the ones already hashed if there are enough */ \
+    if (count >= 8 && bytes != end)                                                 \
+        crc2 = update8(crc2, wyhash::read8(end - 8));                               \
+    else                                                                            \
+        for (; bytes != end; ++bytes)                                               \
+            crc2 = update1(crc2, *bytes);                                           \
+    return finish(crc0, crc1, crc2, count)
+
+inline uint64_t hash_software(const unsigned char* bytes, size_t count, uint64_t seed) noexcept
+{
+    const auto& t = table::instance();
+    auto update8 = [&t](uint32_t crc, uint64_t word) { return update(t, crc, word); };
+    auto update1 = [&t](uint32_t crc, uint8_t byte) { return update(t, crc, byte); };
+    JVN_CRC32C_HASH(update8, update1);
+}
+
+#if JVN(X64)
+// The intrinsics are only available in functions compiled for SSE4.2, so this can't share
+// a template with the software version without compiling it for SSE4.2 as well
+JVN_TARGET("sse4.2") inline uint64_t hash_sse42(const unsigned char* bytes, size_t count, uint64_t seed) noexcept
+{
+#   define JVN_CRC32C_U64(crc, word) uint32_t(_mm_crc32_u64(crc, word))
+    JVN_CRC32C_HASH(JVN_CRC32C_U64, _mm_crc32_u8);
+#   undef JVN_CRC32C_U64
+}
+#endif
+
+#undef JVN_CRC32C_HASH
+
+inline uint64_t hash(const unsigned char* bytes, size_t count, uint64_t seed = 0) noexcept
+{
+    using function_type = uint64_t (*)(const unsigned char*, size_t, uint64_t);
+#if JVN(X64)
+    static const function_type impl = cpu::current().sse42 ? function_type(hash_sse42) : function_type(hash_software);
+#else
+    static const function_type impl = hash_software;
+#endif
+    return impl(bytes, count, seed);
+}
+
+} // namespace crc32c
+
+namespace murmur_hash
+{
+
+// murmur_hash2 of a byte range of char or unsigned char, at compile time as well. The words
+// are read as little endian with wyhash's reads and the tail with at most two overlapping
+// ones, so it returns the same values as murmur_hash2 on the little endian machines
+template <class Byte>
+constexpr size_t murmur_hash2_bytes(const Byte* bytes, size_t count, size_t seed = SEED) noexcept
+{
+    size_t hash = seed ^ (count * m);
+    auto left = count;
+    for (; left >= 8; bytes += 8, left -= 8)
+        hash = absorb(hash, wyhash::read8(bytes));
+    if (left)
+    {
+        size_t tail = 0;
+        if (count >= 8)
+            tail = wyhash::read8(bytes + left - 8) >> (64 - 8 * left);
+        else if (left >= 4)
+            tail = wyhash::read4(bytes) | wyhash::read4(bytes + left - 4) << (8 * (left - 4));
+        else
+            tail = size_t(uint8_t(bytes[0])) | size_t(uint8_t(bytes[left >> 1])) << (8 * (left >> 1)) |
+                size_t(uint8_t(bytes[left - 1])) << (8 * (left - 1));
+        hash ^= tail;
+        hash *= m;
+    }
+    return finalize(hash);
+}
+
+} // namespace murmur_hash
+
+#endif
+
+// The hash of strings and other byte ranges of variable length. On 64-bit the keys up to
+// SHORT_KEY_BYTES are hashed by MurmurHash64A and the longer ones by wyhash: the four 64-bit
+// multiplies of murmur take 2-3 ns for 4-16 bytes where wyhash's three 128-bit ones take 4.5-5,
+// from 20 bytes on wyhash is as fast or faster, 3x faster at 128 bytes (hash_benchmark).
+// crc32c::hash is selected by neither the length nor the CPU: with SSE4.2 it's within the noise
+// of wyhash from 24 to 128 bytes and slower below and above, without it several times slower.
+// Byte is char or unsigned char, both hash the same and the hash can run at compile time
+JVN_INLINE_VAR constexpr size_t SHORT_KEY_BYTES = 16;
+
+template <class Byte>
+constexpr size_t hash_bytes(const Byte* bytes, size_t count, size_t seed = murmur_hash::SEED) noexcept
+{
+#if JVN(BITNESS) == 64
+    if (count <= SHORT_KEY_BYTES)
+        return murmur_hash::murmur_hash2_bytes(bytes, count, seed);
+    return wyhash::wyhash(bytes, count, seed);
+#else
+    return murmur_hash::murmur_hash2(bytes, count, seed);
+#endif
+}
+
+
+// Whether equal values of Ty have equal bytes, so hashing its object representation is valid:
+// no padding and no floating point members, whose +0.0 and -0.0 are equal. Detected with
+// std::has_unique_object_representations, before C++17 only the integers, enums and pointers
+// are known to qualify
+template <class Ty>
+struct is_bytewise_hashable : std::integral_constant<bool,
+#if JVN(CXX17)
+    std::has_unique_object_representations<Ty>::value
+#else
+    std::is_integral<Ty>::value || std::is_enum<Ty>::value || std::is_pointer<Ty>::value
+#endif
+> {};
+
+// Hashes the bytes of a value in a single pass
+template <class Ty>
+size_t hash_object(const Ty& value, size_t seed = murmur_hash::SEED) noexcept
+{
+    return murmur_hash::murmur_hash2(&reinterpret_cast<const unsigned char&>(value), sizeof(value), seed);
+}
+
+// A function object that returns the hash of Kt type
+// By default it uses the MurmurHash2/3 algorithm, strings are hashed by hash_bytes
+// There is also an FNV-1a implementation fnv::fnv_1a(...)
+// Every hash can also be invoked with a seed, see seeded_hash
+// Pairs, tuples and arrays are hashed by their members, see hash_combine
+template <class Kt>
+struct hash
+{
+    // General byte hashing. With C++17 a type with padding or floating point members is rejected,
+    // since equal keys could hash differently, before C++17 its bytes are trusted
+    size_t operator()(const Kt& key, size_t seed = murmur_hash::SEED) const noexcept
+    {
+        static_assert(!JVN(CXX17) || is_bytewise_hashable<Kt>::value, "jvn::hash: the bytes of the key type don't "
+            "determine its value (padding or floating point members), combine the hashes of its members with "
+            "jvn::hash_combine or specialize jvn::hash");
+        return hash_object(key, seed);
+    }
+};
+
+
+// Type specialization
+
+// There's probably a better way with SFINAE or some other conditional
+// enabling. But this is a pretty easy way to do specific specialization
+#define JVN_HASH_INT(Ty)                                                      \
+    template <>                                                               \
+    struct hash<Ty>                                                           \
+    {                                                                         \
+        constexpr size_t operator()(const Ty key) const noexcept              \
+        {                                                                     \
+            return murmur_hash::murmur_hash3_int(size_t(key));                \
+        }                                                                     \
+        constexpr size_t operator()(const Ty key, size_t seed) const noexcept \
+        {                                                                     \
+            return murmur_hash::murmur_hash3_int(size_t(key) ^ seed);         \
+        }                                                                     \
+    }
+
+JVN_HASH_INT(bool);
+JVN_HASH_INT(char);
+JVN_HASH_INT(signed char);
+JVN_HASH_INT(unsigned char);
+JVN_HASH_INT(char16_t);
+JVN_HASH_INT(char32_t);
+JVN_HASH_INT(wchar_t);
+JVN_HASH_INT(short);
+JVN_HASH_INT(unsigned short);
+JVN_HASH_INT(int);
+JVN_HASH_INT(unsigned int);
+JVN_HASH_INT(long);
+JVN_HASH_INT(long long);
+JVN_HASH_INT(unsigned long);
+JVN_HASH_INT(unsigned long long);
+
+// +0.0 and -0.0 are equal, so they're hashed as the same bits. A NaN doesn't equal itself, any hash will do
+template <>
+struct hash<float>
+{
+    size_t operator()(float key) const noexcept { return (*this)(key, 0); }
+    size_t operator()(float key, size_t seed) const noexcept
+    {
+        if (key == 0.0f)
+            key = 0.0f;
+        uint32_t bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        return murmur_hash::murmur_hash3_int(size_t(bits) ^ seed);
+    }
+};
+
+template <>
+struct hash<double>
+{
+    size_t operator()(double key) const noexcept { return (*this)(key, 0); }
+    size_t operator()(double key, size_t seed) const noexcept
+    {
+        if (key == 0.0)
+            key = 0.0;
+        uint64_t bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+#if JVN(BITNESS) == 64
+        return murmur_hash::murmur_hash3_int(size_t(bits) ^ seed);
+#else
+        return murmur_hash::murmur_hash3_int(murmur_hash::absorb(size_t(bits) ^ seed, size_t(bits >> 32)));
+#endif
+    }
+};
+
+template <class Ty>
+struct hash<Ty*> {
+    size_t operator()(Ty* ptr) const noexcept
+    {
+        return murmur_hash::murmur_hash3_int(size_t(ptr));
+    }
+    size_t operator()(Ty* ptr, size_t seed) const noexcept
+    {
+        return murmur_hash::murmur_hash3_int(size_t(ptr) ^ seed);
+    }
+};
+
+// The std::string hash and equality are transparent, a std::string_view or a const char*
+// is looked up without constructing a temporary std::string. All three hash the same, see hash_bytes
+template <>
+struct hash<std::string>
+{
+    using is_transparent = void;
+
+    size_t operator()(const std::string& str, size_t seed = murmur_hash::SEED) const noexcept
+    {
+        return hash_bytes(str.data(), str.size(), seed);
+    }
+
+#if JVN(CXX17)
+    constexpr size_t operator()(std::string_view str, size_t seed = murmur_hash::SEED) const noexcept
+    {
+        return hash_bytes(str.data(), str.size(), seed);
+    }
+#endif
+
+#if JVN(CXX17)
+    // std::char_traits<char>::length is a constexpr strlen
+    constexpr size_t operator()(const char* str, size_t seed = murmur_hash::SEED) const noexcept
+    {
+        return hash_bytes(str, std::char_traits<char>::length(str), seed);
+    }
+#else
+    size_t operator()(const char* str, size_t seed = murmur_hash::SEED) const noexcept
+    {
+        return hash_bytes(str, std::strlen(str), seed);
+    }
+#endif
+};
+
+#if JVN(CXX17)
+// Hashes the same as std::string, at compile time as well, e.g. for the keys of a static_map
+template <>
+struct hash<std::string_view> : hash<std::string> {};
+#endif
+
+// The range reductions, the Range parameter of unordered_map. A range reduces a hash to the
+// index of a slot in a power of two capacity, it's constructed with the capacity whenever the
+// table is resized and invoked on the hash of every lookup.
+
+// The low bits of the hash, the default. A single and, but the hash has to mix all of its bits
+// into the low ones, which the murmur based hashes do
+struct mask_range
+{
+    static JVN_INLINE_VAR constexpr uint32_t id = 0;
+
+    explicit mask_range(size_t capacity = 1) noexcept :m_mask(capacity - 1) {}
+    size_t operator()(size_t hash) const noexcept { return hash & m_mask; }
+
+private:
+    size_t m_mask;
+};
+
+// Fibonacci hashing, the top bits of the hash multiplied by 2^N / golden ratio. The multiply
+// carries every bit of the hash into the top ones, so consecutive, strided or aligned keys are
+// spread evenly even by identity_hash, for the cost of a multiply instead of a hash finalizer
+struct fibonacci_range
+{
+    static JVN_INLINE_VAR constexpr uint32_t id = 1;
+
+    // The mask only matters for a capacity of 1, whose shift would be the width of size_t
+    explicit fibonacci_range(size_t capacity = 1) noexcept
+        :m_shift(capacity > 1 ? unsigned(sizeof(size_t) * 8) - bits(capacity) : 0u), m_mask(capacity - 1) {}
+    size_t operator()(size_t hash) const noexcept { return size_t(hash * GOLDEN) >> m_shift & m_mask; }
+
+private:
+#if JVN(BITNESS) == 64
+    static JVN_INLINE_VAR constexpr size_t GOLDEN = size_t(11400714819323198485ull);
+#else
+    static JVN_INLINE_VAR constexpr size_t GOLDEN = size_t(2654435769u);
+#endif
+
+    unsigned m_shift;
+    size_t m_mask;
+
+    // log2 of a power of two
+    static unsigned bits(size_t capacity) noexcept
+    {
+        unsigned count = 0;
+        while (capacity >>= 1)
+            ++count;
+        return count;
+    }
+};
+
+// The hash folded onto itself, the bits above the index are xored into it before the low bits
+// are masked. Consecutive keys map to consecutive slots without a single collision and the bits
+// that tell aligned pointers or strided keys apart reach the index. A shift cheaper than the
+// multiply of fibonacci_range, for keys that are unique in their low bits, e.g. ids
+struct mix_range
+{
+    static JVN_INLINE_VAR constexpr uint32_t id = 2;
+
+    explicit mix_range(size_t capacity = 1) noexcept :m_bits(0), m_mask(capacity - 1)
+    {
+        while (capacity >>= 1)
+            ++m_bits;
+    }
+    size_t operator()(size_t hash) const noexcept { return (hash ^ hash >> m_bits) & m_mask; }
+
+private:
+    unsigned m_bits;
+    size_t m_mask;
+};
+
+// The key itself as the hash of integer and pointer keys, reduced by fibonacci_range unless
+// the map is given another Range. Skips the murmur finalizer of hash<Kt>, the range does the mixing
+template <class Kt>
+struct identity_hash
+{
+    using range_type = fibonacci_range;
+
+    constexpr size_t operator()(const Kt key) const noexcept { return size_t(key); }
+    constexpr size_t operator()(const Kt key, size_t seed) const noexcept { return size_t(key) ^ seed; }
+};
+
+template <class Ty>
+struct identity_hash<Ty*>
+{
+    using range_type = fibonacci_range;
+
+    size_t operator()(Ty* ptr) const noexcept { return size_t(ptr); }
+    size_t operator()(Ty* ptr, size_t seed) const noexcept { return size_t(ptr) ^ seed; }
+};
+
+// The range_type member of a hash, mask_range if it has none
+template <class Hash, class = void>
+struct default_range { using type = mask_range; };
+
+template <class Hash>
+struct default_range<Hash, decltype(void(std::declval<typename Hash::range_type*>()))> { using type = typename Hash::range_type; };
+
+template <class Hash>
+using default_range_t = typename default_range<Hash>::type;
+
+// Composite keys ---------------------------------------
+
+// The word a member of a composite key adds to the hash. Integers, enums and pointers as they are,
+// since the combine mixes them anyway, the other members by their own hash with the seed
+template <class Ty, std::enable_if_t<(std::is_integral<Ty>::value || std::is_enum<Ty>::value) &&
+    sizeof(Ty) <= sizeof(size_t), int> = 0>
+constexpr size_t hash_word(const Ty& value, size_t) noexcept { return size_t(value); }
+
+template <class Ty>
+size_t hash_word(Ty* value, size_t) noexcept { return size_t(value); }
+
+// True if the hash of Ty takes a seed, a user specialization may only take the key
+template <class Ty, class = void>
+struct has_seeded_hash : std::false_type {};
+
+template <class Ty>
+struct has_seeded_hash<Ty, decltype(void(std::declval<hash<Ty>>()(std::declval<const Ty&>(), size_t())))> : std::true_type {};
+
+template <class Ty>
+size_t hash_member(const Ty& value, size_t seed, std::true_type) noexcept { return hash<Ty>{}(value, seed); }
+
+// The seed is mixed into the hash of the key, the member still changes with it
+template <class Ty>
+size_t hash_member(const Ty& value, size_t seed, std::false_type) noexcept { return murmur_hash::absorb(seed, hash<Ty>{}(value)); }
+
+template <class Ty, std::enable_if_t<!((std::is_integral<Ty>::value || std::is_enum<Ty>::value) &&
+    sizeof(Ty) <= sizeof(size_t)), int> = 0>
+size_t hash_word(const Ty& value, size_t seed) noexcept { return hash_member(value, seed, has_seeded_hash<Ty>()); }
+
+// Hashes the values in a single pass, as one murmur hash of a word per value, instead of mixing
+// the full hash of each value into the previous ones. For the keys of several members, e.g.
+//     size_t operator()(const key& k) const noexcept { return jvn::hash_combine(k.id, k.name); }
+// The seed is passed on to the hashes of the members that aren't integers, see seeded_hash
+template <class... Ty>
+size_t hash_combine_seed(size_t seed, const Ty&... values) noexcept
+{
+    auto hash = seed ^ (sizeof...(Ty) * sizeof(size_t) * murmur_hash::m);
+    (void)std::initializer_list<int>{ (hash = murmur_hash::absorb(hash, hash_word(values, seed)), 0)... };
+    return murmur_hash::finalize(hash);
+}
+
+template <class... Ty>
+size_t hash_combine(const Ty&... values) noexcept { return hash_combine_seed(murmur_hash::SEED, values...); }
+
+// A pair, tuple or array without padding and floating point members is hashed as a single block
+// of bytes, otherwise its members are combined
+template <class T1, class T2>
+struct hash<pair<T1, T2>>
+{
+    size_t operator()(const pair<T1, T2>& key, size_t seed = murmur_hash::SEED) const noexcept
+    { return hashKey(key, seed, is_bytewise_hashable<pair<T1, T2>>()); }
+
+private:
+    static size_t hashKey(const pair<T1, T2>& key, size_t seed, std::true_type) noexcept { return hash_object(key, seed); }
+    static size_t hashKey(const pair<T1, T2>& key, size_t seed, std::false_type) noexcept
+    { return hash_combine_seed(seed, key.first, key.second); }
+};
+
+template <class T1, class T2>
+struct hash<std::pair<T1, T2>>
+{
+    size_t operator()(const std::pair<T1, T2>& key, size_t seed = murmur_hash::SEED) const noexcept
+    { return hash_combine_seed(seed, key.first, key.second); }
+};
+
+// A std::tuple isn't trivially copyable, its members are always combined
+template <class... Ty>
+struct hash<std::tuple<Ty...>>
+{
+    size_t operator()(const std::tuple<Ty...>& key, size_t seed = murmur_hash::SEED) const noexcept
+    { return hashKey(key, seed, std::index_sequence_for<Ty...>()); }
+
+private:
+    template <size_t... Idx>
+    static size_t hashKey(const std::tuple<Ty...>& key, size_t seed, std::index_sequence<Idx...>) noexcept
+    { return hash_combine_seed(seed, std::get<Idx>(key)...); }
+};
+
+// Fixed length strings as well, e.g. std::array<char, 16>
+template <class Ty, size_t N>
+struct hash<std::array<Ty, N>>
+{
+    size_t operator()(const std::array<Ty, N>& key, size_t seed = murmur_hash::SEED) const noexcept
+    { return hashKey(key, seed, is_bytewise_hashable<std::array<Ty, N>>()); }
+
+private:
+    static size_t hashKey(const std::array<Ty, N>& key, size_t seed, std::true_type) noexcept { return hash_object(key, seed); }
+    static size_t hashKey(const std::array<Ty, N>& key, size_t seed, std::false_type) noexcept
+    {
+        auto hash = seed ^ (N * sizeof(size_t) * murmur_hash::m);
+        for (auto& value : key)
+            hash = murmur_hash::absorb(hash, hash_word(value, seed));
+        return murmur_hash::finalize(hash);
+    }
+};
+
+// Hashes the keys of [first, last) into out, returns the end of the output.
+// The hashes don't depend on each other so the hashing of consecutive keys overlaps in the
+// pipeline, unlike the hashing interleaved with the probing of a lookup
+template <class InputIt, class OutputIt,
+    class Hash = hash<typename std::iterator_traits<InputIt>::value_type>>
+OutputIt hash_bulk(InputIt first, InputIt last, OutputIt out, const Hash& hasher = Hash())
+{
+    for (; first != last; ++first, ++out)
+        *out = hasher(*first);
+    return out;
+}
+
+template <>
+struct equal_to<std::string>
+{
+    using is_transparent = void;
+
+    bool operator()(const std::string& lhs, const std::string& rhs) const noexcept { return lhs == rhs; }
+#if JVN(CXX17)
+    bool operator()(const std::string& lhs, std::string_view rhs) const noexcept { return lhs == rhs; }
+    bool operator()(std::string_view lhs, const std::string& rhs) const noexcept { return lhs == rhs; }
+#endif
+    bool operator()(const std::string& lhs, const char* rhs) const noexcept { return lhs == rhs; }
+    bool operator()(const char* lhs, const std::string& rhs) const noexcept { return lhs == rhs; }
+};
+
+#if JVN(CXX17)
+// A std::string and a const char* convert to std::string_view, one comparison covers all three
+template <>
+struct equal_to<std::string_view>
+{
+    using is_transparent = void;
+
+    constexpr bool operator()(std::string_view lhs, std::string_view rhs) const noexcept { return lhs == rhs; }
+};
+#endif
+
+// Returns a random seed, drawn from a thread local generator seeded once by std::random_device
+inline size_t random_seed()
+{
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    return size_t(generator());
+}
+
+template <class Hash, class = void>
+struct transparent_hash_base {};
+
+template <class Hash>
+struct transparent_hash_base<Hash, std::enable_if_t<is_transparent<Hash>::value>> { using is_transparent = void; };
+
+// A hash with a per instance random seed, for maps keyed by untrusted input.
+// Without knowing the seed an attacker can't craft keys that collide, flooding the map.
+// It's stateful, so the map holds an instance instead of default constructing it for every hash
+template <class Kt, class Hash = hash<Kt>>
+struct seeded_hash : transparent_hash_base<Hash>
+{
+    seeded_hash() :seed(random_seed()) {}
+    explicit seeded_hash(size_t seed) noexcept :seed(seed) {}
+
+    template <class K>
+    size_t operator()(const K& key) const noexcept { return Hash{}(key, seed); }
+
+    size_t seed;
+};
+
 } // namespace jvn
\ No newline at end of file
@@ -0,0 +1,325 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+// std::unique_ptr
+#include <memory>
+
+namespace jvn
+{
+
+    // An unordered_map that grows without rehashing all of its elements at once. When the table
+    // is full a table GROWTH_FACTOR times larger is allocated and the full one is kept as the old
+    // table, every following insert, erase and non-const find moves the elements of up to
+    // MIGRATE_STEP slots of the old table to the new one. The lookups search both tables until
+    // the old one is empty and freed, so no single operation does O(size()) work for the rehash.
+    // The step is large enough for the old table to be empty before the new one fills up.
+
+    // The bucket of the new table is allocated once the table is half full and its info bytes are
+    // cleared a chunk per operation as well, since writing them at once page faults the whole
+    // allocation. The price is a second probe for the keys that aren't in the new table while
+    // migrating and holding both buckets from the half full table to the end of the migration.
+    // Freeing the old bucket and an insert that would displace an element past the displacement
+    // limit, which grows the new table in one go as unordered_map does, aren't spread.
+
+    // Any non-const member function may move elements, which invalidates the iterators and, for a
+    // node_map, the references as well, since a migrated pair is moved to a node of the new table.
+    template <class Kt, class Vt, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout, bool StoreHash = false, class Storage = flat_storage>
+        class incremental_map
+    {
+    public:
+        using map_type              = unordered_map<Kt, Vt, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage>;
+        using hasher                = Hasher;
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = pair<Kt, Vt>;
+        using pointer               = value_type*;
+        using reference             = value_type&;
+        using const_reference       = const value_type&;
+        using size_type             = typename map_type::size_type;
+        using difference_type       = typename map_type::difference_type;
+        using allocator_type        = Alloc;
+
+        // Walks the old table and then the new one
+        class Iter
+        {
+        public:
+            using iterator_category     = std::forward_iterator_tag;
+            using value_type            = typename incremental_map::value_type;
+            using difference_type       = typename incremental_map::difference_type;
+            using pointer               = typename incremental_map::pointer;
+            using reference             = typename incremental_map::const_reference;
+
+            Iter(const incremental_map* map, bool in_old, typename map_type::iterator iter)
+                :m_map(map), m_in_old(in_old), m_iter(iter)
+            {
+                skipOld();
+            }
+
+            friend bool operator==(const Iter& lhs, const Iter& rhs) { return lhs.m_in_old == rhs.m_in_old && lhs.m_iter == rhs.m_iter; }
+            friend bool operator!=(const Iter& lhs, const Iter& rhs) { return !(lhs == rhs); }
+            Iter& operator++()
+            {
+                ++m_iter;
+                skipOld();
+                return *this;
+            }
+            pointer operator->() const { return m_iter.operator->(); }
+            reference operator*() const { return *m_iter; }
+        private:
+            const incremental_map* m_map;
+            bool m_in_old;
+            typename map_type::iterator m_iter;
+
+            void skipOld()
+            {
+                if (m_in_old && m_iter == m_map->m_old->end())
+                {
+                    m_in_old = false;
+                    m_iter = m_map->m_current->begin();
+                }
+            }
+        };
+
+        friend class Iter;
+        using iterator              = Iter;
+
+        incremental_map(float load_factor = 0.75f, size_type inital_capacity = 128u, size_type growth_factor = 16u,
+            const hasher& hash = hasher(), const key_equal& equal = key_equal(), const allocator_type& alloc = allocator_type())
+            :m_current(new map_type(load_factor, inital_capacity, growth_factor, hash, equal, alloc))
+        {}
+
+        incremental_map(const incremental_map&) = delete;
+        incremental_map& operator=(const incremental_map&) = delete;
+
+        ~incremental_map()
+        {
+            if (m_next_bucket)
+                releaseNext();
+        }
+
+        mapped_type& operator[](const key_type& key) { return try_emplace(key).first->second; }
+        mapped_type& operator[](key_type&& key) { return try_emplace(std::move(key)).first->second; }
+
+        // Takes a step of the migration before the lookup
+        iterator find(const key_type& key)
+        {
+            step();
+            return lookup(key);
+        }
+        iterator find(const key_type& key) const { return lookup(key); }
+
+        bool contains(const key_type& key) const { return lookup(key) != end(); }
+        size_type count(const key_type& key) const { return size_type(contains(key)); }
+
+        template <class Ty, std::enable_if_t<std::is_same<std::decay_t<Ty>, value_type>::value, int> = 0>
+        pair<iterator, bool> insert(Ty&& key_value_pair)
+        {
+            return emplaceKey(key_value_pair.first, std::forward<Ty>(key_value_pair));
+        }
+
+        template <class K, class V, std::enable_if_t<std::is_same<std::decay_t<K>, key_type>::value, int> = 0>
+        pair<iterator, bool> emplace(K&& key, V&& value)
+        {
+            return emplaceKey(key, std::forward<K>(key), std::forward<V>(value));
+        }
+
+        template <class... Args>
+        pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template <class... Args>
+        pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template <class M>
+        pair<iterator, bool> insert_or_assign(const key_type& key, M&& value)
+        {
+            auto result = try_emplace(key, std::forward<M>(value));
+            if (!result.second)
+                result.first->second = std::forward<M>(value);
+            return result;
+        }
+
+        size_type erase(const key_type& key)
+        {
+            step();
+            if (m_current->erase(key))
+                return size_type(1);
+            return m_old ? m_old->erase(key) : size_type(0);
+        }
+
+        // Moves the rest of the old table at once, e.g. while the map is idle
+        void finish_migration()
+        {
+            while (m_old)
+                migrate();
+        }
+
+        bool migrating() const noexcept { return bool(m_old); }
+
+        size_type size() const noexcept { return m_current->size() + (m_old ? m_old->size() : size_type(0)); }
+        bool empty() const noexcept { return !size(); }
+        // The capacity of the new table
+        size_type bucket_count() const noexcept { return m_current->bucket_count(); }
+        float load_factor() const noexcept { return float(size()) / float(bucket_count()); }
+        float max_load_factor() const noexcept { return m_current->max_load_factor(); }
+        hasher hash_function() const { return m_current->hash_function(); }
+        key_equal key_eq() const { return m_current->key_eq(); }
+        allocator_type get_allocator() const { return m_current->get_allocator(); }
+
+        iterator begin() const { return m_old ? iterator(this, true, m_old->begin()) : iterator(this, false, m_current->begin()); }
+        iterator end() const { return iterator(this, false, m_current->end()); }
+
+    private:
+        // A step either moves an element or passes an empty slot. Emptying the old table before the
+        // new one fills up takes (1 + max_load_factor()) / (max_load_factor() * (GROWTH_FACTOR - 1))
+        // steps per insert, 5 for a load factor of 0.25 and a growth factor of 2. If it isn't empty
+        // by then, e.g. for a lower load factor, the next grow finishes the migration at once
+        static JVN_INLINE_VAR constexpr size_type MIGRATE_STEP = 16;
+
+        using slot_type             = typename map_type::slot_type;
+
+        std::unique_ptr<map_type> m_current;
+        // The table being migrated, null once it's empty
+        std::unique_ptr<map_type> m_old;
+        // The slots of the old table before it are empty
+        size_type m_migrate_idx = 0;
+        // The bucket of the next table, allocated once the current table is half full. Its slots
+        // [0, m_cleared) are marked empty
+        uint8_t* m_next_bucket = nullptr;
+        size_type m_next_capacity = 0;
+        size_type m_cleared = 0;
+
+        iterator lookup(const key_type& key) const
+        {
+            auto iter = m_current->find(key);
+            if (iter != m_current->end() || !m_old)
+                return iterator(this, false, iter);
+            iter = m_old->find(key);
+            return iter != m_old->end() ? iterator(this, true, iter) : end();
+        }
+
+        template <class... Args>
+        pair<iterator, bool> emplaceKey(const key_type& key, Args&&... args)
+        {
+            step();
+            auto iter = lookup(key);
+            if (iter != end())
+                return pair<iterator, bool>(iter, false);
+
+            if (JVN_UNLIKELY(m_current->m_size + 1 >= m_current->m_max_elems))
+                startGrow();
+            auto hash = m_current->m_hasher(key);
+            auto idx = m_current->placeUnique(hash, std::forward<Args>(args)...);
+            return pair<iterator, bool>(iterator(this, false,
+                typename map_type::iterator(m_current->m_info_bucket, m_current->m_capacity, idx)), true);
+        }
+
+        // The work spread over the operations
+        void step()
+        {
+            migrate();
+            prepare();
+        }
+
+        // Takes MIGRATE_STEP steps of the migration
+        void migrate()
+        {
+            if (!m_old)
+                return;
+            auto& old = *m_old;
+            for (size_type count = 0; count != MIGRATE_STEP && old.m_size; ++count)
+            {
+                // The slot is refilled by the next element of its cluster, if there is one
+                if (old.info(m_migrate_idx) != uint8_t(-1))
+                    old.moveSlotTo(m_migrate_idx, *m_current);
+                else
+                    ++m_migrate_idx;
+            }
+            if (!old.m_size)
+                m_old.reset();
+        }
+
+        // Clears the info bytes of the next bucket, writing them all at the grow would page fault
+        // the whole allocation in one operation. The slots left are spread over the inserts left
+        // until the grow, at most 2 * GROWTH_FACTOR / max_load_factor() slots per insert
+        void prepare()
+        {
+            auto& full = *m_current;
+            if (!full.allocated())
+                return;
+            // The current table grew on its own since the next bucket was allocated
+            if (m_next_bucket && m_next_capacity != full.m_capacity * full.GROWTH_FACTOR)
+                releaseNext();
+            if (!m_next_bucket)
+            {
+                if (full.m_size < full.m_max_elems / 2)
+                    return;
+                m_next_capacity = full.m_capacity * full.GROWTH_FACTOR;
+                m_next_bucket = full.allocateRaw(m_next_capacity);
+                m_cleared = 0;
+            }
+            if (m_cleared == m_next_capacity)
+                return;
+            auto inserts = full.m_size + 1 < full.m_max_elems ? full.m_max_elems - full.m_size - 1 : size_type(1);
+            auto count = (m_next_capacity - m_cleared + inserts - 1) / inserts;
+            map_type::clearInfo(m_next_bucket, m_next_capacity, m_cleared, m_cleared + count);
+            m_cleared += count;
+        }
+
+        // Makes the full table the old one and the next bucket the current table. The previous
+        // migration is finished first. A table without a bucket allocates its initial one instead
+        void startGrow()
+        {
+            finish_migration();
+            auto& full = *m_current;
+            if (!full.allocated())
+            {
+                full.grow();
+                return;
+            }
+            auto capacity = full.m_capacity * full.GROWTH_FACTOR;
+            if (m_next_bucket && m_next_capacity != capacity)
+                releaseNext();
+            if (!m_next_bucket)
+            {
+                m_next_capacity = capacity;
+                m_next_bucket = full.allocateRaw(capacity);
+                m_cleared = 0;
+            }
+            map_type::clearInfo(m_next_bucket, m_next_capacity, m_cleared, m_next_capacity);
+
+            std::unique_ptr<map_type> grown;
+            try
+            {
+                grown.reset(new map_type(m_next_bucket, m_next_capacity, full.LOAD_FACTOR, full.GROWTH_FACTOR,
+                    full.m_hasher, full.m_key_equal, full.get_allocator()));
+            }
+            catch (...)
+            {
+                releaseNext();
+                throw;
+            }
+            m_next_bucket = nullptr;
+            m_old = std::move(m_current);
+            m_current = std::move(grown);
+            m_migrate_idx = 0;
+        }
+
+        void releaseNext() noexcept
+        {
+            m_current->deallocateRaw(m_next_bucket, m_next_capacity);
+            m_next_bucket = nullptr;
+        }
+    };
+
+} // namespace jvn
@@ -0,0 +1,426 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "utility.h"
+#include "hash.h"
+// size_t
+#include <cstddef>
+// std::allocator_traits
+#include <memory>
+
+#if JVN(SIMD) == JVN_SIMD_AVX2
+#   include <immintrin.h>
+#elif JVN(SIMD) == JVN_SIMD_SSE2
+#   include <emmintrin.h>
+#endif
+
+namespace jvn
+{
+
+// A slot of jvn::unordered_map, the key-value pair and optionally the cached hash of its key.
+// With the hash cached a probe rules out a different key without comparing the keys and
+// grow() rehashes without invoking the hasher, at the cost of a size_t per slot
+template <class Ty, bool StoreHash>
+struct slot
+{
+    template <class... Args>
+    explicit slot(size_t, Args&&... args) :value(std::forward<Args>(args)...) {}
+
+    Ty value;
+};
+
+template <class Ty>
+struct slot<Ty, true>
+{
+    template <class... Args>
+    explicit slot(size_t hash, Args&&... args) :hash(hash), value(std::forward<Args>(args)...) {}
+
+    size_t hash;
+    Ty value;
+};
+
+// Element storage of jvn::unordered_map
+
+// A Storage decides what a slot holds for a key-value pair, Storage::storage<Ty, Alloc> is held
+// by the map. The elements are moved between slots as element_type, get() returns the pair.
+// bytes_allocated() is what the storage allocated on top of the bucket, for unordered_map::stats().
+
+// The pairs themselves, the default storage
+struct flat_storage
+{
+    template <class Ty, class Alloc>
+    struct storage
+    {
+        static JVN_INLINE_VAR constexpr bool node_based = false;
+        using element_type = Ty;
+
+        storage() noexcept = default;
+        explicit storage(const Alloc&) noexcept {}
+
+        static Ty& get(element_type& element) noexcept { return element; }
+        // The pair is destroyed along with its slot
+        void destroy(element_type&) noexcept {}
+
+        size_t bytes_allocated() const noexcept { return 0; }
+    };
+};
+
+// Allocates the nodes of node_storage from blocks of growing size that stay in place until the
+// pool is destroyed, so a node never moves. Destroyed nodes are reused through a free list.
+// The pool doesn't track the live nodes, they have to be destroyed before the pool
+template <class Ty, class Alloc>
+class node_pool
+{
+public:
+    node_pool() = default;
+    explicit node_pool(const Alloc& alloc) :m_allocator(alloc) {}
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+
+    ~node_pool()
+    {
+        // The blocks are linked newest first through their first node
+        auto block_idx = m_block_count;
+        while (m_blocks)
+        {
+            auto next = m_blocks->next;
+            node_traits::deallocate(m_allocator, m_blocks, blockSize(--block_idx));
+            m_blocks = next;
+        }
+    }
+
+    template <class... Args>
+    Ty* create(Args&&... args)
+    {
+        auto n = allocateNode();
+        try
+        {
+            ::new (&n->value) Ty(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            freeNode(n);
+            throw;
+        }
+        return &n->value;
+    }
+
+    void destroy(Ty* value) noexcept
+    {
+        value->~Ty();
+        freeNode(reinterpret_cast<node*>(value));
+    }
+
+    // The size of the blocks, the free and the not yet used nodes included
+    size_t bytes_allocated() const noexcept
+    {
+        auto nodes = m_block_count < 8 ? FIRST_BLOCK * ((size_t(1) << m_block_count) - 1) :
+            FIRST_BLOCK * 255 + (m_block_count - 8) * MAX_BLOCK;
+        return nodes * sizeof(node);
+    }
+
+private:
+    // A node is either a value or a link of the free list
+    union node
+    {
+        node() noexcept {}
+        ~node() {}
+
+        node* next;
+        Ty value;
+    };
+
+    using node_allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<node>;
+    using node_traits = std::allocator_traits<node_allocator_type>;
+
+    static JVN_INLINE_VAR constexpr size_t FIRST_BLOCK = 16;
+    static JVN_INLINE_VAR constexpr size_t MAX_BLOCK = 4096;
+
+    node* m_blocks = nullptr;
+    size_t m_block_count = 0;
+    // The unused nodes of the newest block
+    node* m_next = nullptr;
+    node* m_end = nullptr;
+    node* m_free = nullptr;
+    node_allocator_type m_allocator;
+
+    // The first node of a block links to the previous block, the sizes double up to MAX_BLOCK
+    static size_t blockSize(size_t block_idx) noexcept
+    {
+        return block_idx < 8 ? FIRST_BLOCK << block_idx : MAX_BLOCK;
+    }
+
+    node* allocateNode()
+    {
+        if (m_free)
+        {
+            auto n = m_free;
+            m_free = n->next;
+            return n;
+        }
+        if (m_next == m_end)
+        {
+            auto size = blockSize(m_block_count);
+            auto block = node_traits::allocate(m_allocator, size);
+            block->next = m_blocks;
+            m_blocks = block;
+            ++m_block_count;
+            m_next = block + 1;
+            m_end = block + size;
+        }
+        return m_next++;
+    }
+
+    void freeNode(node* n) noexcept
+    {
+        n->next = m_free;
+        m_free = n;
+    }
+};
+
+// A pointer to the pair in the slot, the pairs are allocated from a node_pool.
+// A probe or a shift moves only the pointer, so the slots stay small for large pairs and
+// the references to the pairs stay valid until they're erased, grow() included
+struct node_storage
+{
+    template <class Ty, class Alloc>
+    class storage
+    {
+    public:
+        static JVN_INLINE_VAR constexpr bool node_based = true;
+        using element_type = Ty*;
+
+        storage() = default;
+        explicit storage(const Alloc& alloc) :m_pool(alloc) {}
+
+        static Ty& get(element_type element) noexcept { return *element; }
+
+        template <class... Args>
+        element_type create(Args&&... args) { return m_pool.create(std::forward<Args>(args)...); }
+        void destroy(element_type element) noexcept { m_pool.destroy(element); }
+
+        size_t bytes_allocated() const noexcept { return m_pool.bytes_allocated(); }
+
+    private:
+        node_pool<Ty, Alloc> m_pool;
+    };
+};
+
+// Slot layouts of jvn::unordered_map
+
+// A layout decides where the info byte and the slot (the key-value pair) are placed inside
+// the single allocation backing the table. Every layout reserves one extra info byte past the
+// last slot that is never empty, it's used for the differentiation of the end() iterator.
+// The layouts are stateless, all of the functions take the beginning of the allocation and
+// the capacity of the table. The id tells the layouts apart in a saved map (map_view.h).
+
+// The info byte followed by the key-value pair, the default layout.
+// Probing a slot touches a single cache line, but consecutive info bytes are sizeof(Ty) + 1
+// bytes apart so a long probe sequence touches a new cache line for almost every slot.
+struct interleaved_layout
+{
+    // The info bytes of neighbouring slots aren't next to each other so they can't be
+    // probed in groups
+    static JVN_INLINE_VAR constexpr bool contiguous_info = false;
+    static JVN_INLINE_VAR constexpr uint32_t id = 1;
+
+    template <class Ty>
+    static constexpr size_t allocation_size(size_t capacity) noexcept { return capacity * (1 + sizeof(Ty)) + 1; }
+
+    template <class Ty>
+    static uint8_t* info(uint8_t* base, size_t, size_t idx) noexcept { return base + idx * (1 + sizeof(Ty)); }
+
+    template <class Ty>
+    static Ty* value(uint8_t* base, size_t, size_t idx) noexcept
+    { return reinterpret_cast<Ty*>(base + idx * (1 + sizeof(Ty)) + 1); }
+};
+
+// All of the info bytes in one contiguous array followed by the array of key-value pairs.
+// A single cache line of info bytes can rule out a whole group of slots, so misses and
+// long probe sequences are resolved without touching the pairs. The pairs are aligned.
+struct separate_layout
+{
+    // The info bytes are probed info_group::WIDTH at a time
+    static JVN_INLINE_VAR constexpr bool contiguous_info = true;
+    static JVN_INLINE_VAR constexpr uint32_t id = 2;
+
+    // The info array (including the end byte) is padded to the alignment of the pairs
+    template <class Ty>
+    static constexpr size_t values_offset(size_t capacity) noexcept
+    {
+        static_assert(alignof(Ty) <= alignof(std::max_align_t), "The bucket is only aligned to std::max_align_t");
+        return (capacity + 1 + alignof(Ty) - 1) & ~(alignof(Ty) - 1);
+    }
+
+    template <class Ty>
+    static constexpr size_t allocation_size(size_t capacity) noexcept
+    { return values_offset<Ty>(capacity) + capacity * sizeof(Ty); }
+
+    template <class Ty>
+    static uint8_t* info(uint8_t* base, size_t, size_t idx) noexcept { return base + idx; }
+
+    template <class Ty>
+    static Ty* value(uint8_t* base, size_t capacity, size_t idx) noexcept
+    { return reinterpret_cast<Ty*>(base + values_offset<Ty>(capacity)) + idx; }
+};
+
+// Blocks of Width info bytes followed by Width aligned key-value pairs.
+// Unlike interleaved_layout every pair is aligned, and unlike separate_layout the info byte and
+// the pair of a slot are in the same block instead of a whole info array apart. A probe reads the
+// info bytes of the block, which share a cache line, and the pair of a matching slot, one or two
+// lines in total. The info bytes are probed one by one, the wider the block the fewer probes
+// cross into the next block but the further the pairs are from the info bytes.
+// The bucket is aligned to std::max_align_t, so are the pairs up to that alignment
+template <size_t Width = 8>
+struct grouped_layout
+{
+    static_assert(Width && !(Width & (Width - 1)), "The width of a block must be a power of two");
+
+    // The info bytes are only contiguous inside a block
+    static JVN_INLINE_VAR constexpr bool contiguous_info = false;
+    static JVN_INLINE_VAR constexpr uint32_t id = 3 | uint32_t(Width) << 8;
+
+    // The info bytes are padded to the alignment of the pairs
+    template <class Ty>
+    static constexpr size_t values_offset() noexcept
+    {
+        static_assert(alignof(Ty) <= alignof(std::max_align_t), "The bucket is only aligned to std::max_align_t");
+        return (Width + alignof(Ty) - 1) & ~(alignof(Ty) - 1);
+    }
+
+    // A multiple of alignof(Ty) since sizeof(Ty) is, so every block is aligned
+    template <class Ty>
+    static constexpr size_t block_size() noexcept { return values_offset<Ty>() + Width * sizeof(Ty); }
+
+    // The end byte is the first info byte of an extra block, or the one past the last slot if
+    // the capacity is less than Width
+    template <class Ty>
+    static constexpr size_t allocation_size(size_t capacity) noexcept
+    { return (capacity + Width - 1) / Width * block_size<Ty>() + 1; }
+
+    template <class Ty>
+    static uint8_t* info(uint8_t* base, size_t, size_t idx) noexcept
+    { return base + idx / Width * block_size<Ty>() + idx % Width; }
+
+    template <class Ty>
+    static Ty* value(uint8_t* base, size_t, size_t idx) noexcept
+    { return reinterpret_cast<Ty*>(base + idx / Width * block_size<Ty>() + values_offset<Ty>()) + idx % Width; }
+};
+
+// A group of consecutive info bytes that are compared at once, 32 bytes with AVX2,
+// 16 bytes with SSE2 and 8 bytes one by one otherwise.
+// Bit j of a returned mask corresponds to the j-th slot of the group.
+class info_group
+{
+public:
+    using mask_type = uint32_t;
+
+#if JVN(SIMD) == JVN_SIMD_AVX2
+    static JVN_INLINE_VAR constexpr size_t WIDTH = 32;
+
+    explicit info_group(const uint8_t* ptr) noexcept
+        :m_info(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr))) {}
+
+    // Slots that are exactly id + j away from the hash position
+    mask_type match(uint8_t id) const noexcept
+    { return mask_type(_mm256_movemask_epi8(_mm256_cmpeq_epi8(m_info, distances(id)))); }
+
+    // Slots that are empty or closer than id + j to their hash position, i.e. where
+    // a probe sequence that's at distance id on the first slot of the group ends.
+    // The info is incremented so the empty slots wrap around to 0 and the comparison
+    // becomes info + 1 <= id + j, done with min since there's no unsigned byte comparison
+    mask_type stop(uint8_t id) const noexcept
+    {
+        auto info = _mm256_add_epi8(m_info, _mm256_set1_epi8(1));
+        return mask_type(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(info, distances(id)), info)));
+    }
+
+    // Slots that hold an element
+    mask_type taken() const noexcept
+    { return ~mask_type(_mm256_movemask_epi8(_mm256_cmpeq_epi8(m_info, _mm256_set1_epi8(char(-1))))); }
+
+private:
+    __m256i m_info;
+
+    static __m256i distances(uint8_t id) noexcept
+    {
+        return _mm256_add_epi8(_mm256_set1_epi8(char(id)), _mm256_setr_epi8(
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+            16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31));
+    }
+
+#elif JVN(SIMD) == JVN_SIMD_SSE2
+    static JVN_INLINE_VAR constexpr size_t WIDTH = 16;
+
+    explicit info_group(const uint8_t* ptr) noexcept
+        :m_info(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr))) {}
+
+    // Slots that are exactly id + j away from the hash position
+    mask_type match(uint8_t id) const noexcept
+    { return mask_type(_mm_movemask_epi8(_mm_cmpeq_epi8(m_info, distances(id)))); }
+
+    // Slots that are empty or closer than id + j to their hash position, i.e. where
+    // a probe sequence that's at distance id on the first slot of the group ends.
+    // The info is incremented so the empty slots wrap around to 0 and the comparison
+    // becomes info + 1 <= id + j, done with min since there's no unsigned byte comparison
+    mask_type stop(uint8_t id) const noexcept
+    {
+        auto info = _mm_add_epi8(m_info, _mm_set1_epi8(1));
+        return mask_type(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(info, distances(id)), info)));
+    }
+
+    // Slots that hold an element
+    mask_type taken() const noexcept
+    { return ~mask_type(_mm_movemask_epi8(_mm_cmpeq_epi8(m_info, _mm_set1_epi8(char(-1))))) & mask_type(0xffff); }
+
+private:
+    __m128i m_info;
+
+    static __m128i distances(uint8_t id) noexcept
+    {
+        return _mm_add_epi8(_mm_set1_epi8(char(id)),
+            _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    }
+
+#else
+    static JVN_INLINE_VAR constexpr size_t WIDTH = 8;
+
+    explicit info_group(const uint8_t* ptr) noexcept :m_info(ptr) {}
+
+    // Slots that are exactly id + j away from the hash position
+    mask_type match(uint8_t id) const noexcept
+    {
+        mask_type mask = 0;
+        for (size_t j = 0; j < WIDTH; ++j)
+            mask |= mask_type(m_info[j] == uint8_t(id + j)) << j;
+        return mask;
+    }
+
+    // Slots that are empty or closer than id + j to their hash position
+    mask_type stop(uint8_t id) const noexcept
+    {
+        mask_type mask = 0;
+        for (size_t j = 0; j < WIDTH; ++j)
+            mask |= mask_type(m_info[j] == uint8_t(-1) || m_info[j] < id + j) << j;
+        return mask;
+    }
+
+    // Slots that hold an element
+    mask_type taken() const noexcept
+    {
+        mask_type mask = 0;
+        for (size_t j = 0; j < WIDTH; ++j)
+            mask |= mask_type(m_info[j] != uint8_t(-1)) << j;
+        return mask;
+    }
+
+private:
+    const uint8_t* m_info;
+#endif
+
+public:
+    // The largest distance a group can be probed from without the distances of its
+    // slots overflowing into the empty marker
+    static JVN_INLINE_VAR constexpr uint8_t MAX_ID = uint8_t(0xfe - (WIDTH - 1));
+};
+
+} // namespace jvn
@@ -1,318 +1,1250 @@
-// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
-#pragma once
-#include "utility.h"
-#include "hash.h"
-// std::allocator
-#include <memory>
-
-namespace jvn
-{
-
-    // An hashmap implementation, using the RobinHood algorithm.
-    // By default it should be noticably faster than std::unordered_map.
-
-    // The memory layout is one byte containing the distance from the hash position
-    // followed by a key-value pair. The number of allocated elements is always 2^n in order for
-    // the hash to be optimaly trimmed to the size range of the bucket. The memory is allocated
-    // for the pairs but they are not constructed until a key key-value is inserted.
-    // The info byte is next to the pair in order to limit cache misses when accessing
-    // elements. The potential cache miss compared to the alignment difference ought to
-    // be more impactfull on the map's efficacy.
-
-    template <class Kt, class Vt, class Hasher = hash<Kt>,
-        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>>
-        class unordered_map
-    {
-    public:
-        using hasher                = Hasher;
-        using mapped_type           = Vt;
-        using key_type              = Kt;
-        using key_equal             = KeyEq;
-        using value_type            = pair<Kt, Vt>;
-        using pointer               = value_type*;
-        using reference             = value_type&;
-        using const_reference       = const value_type&;
-        using size_type             = typename Alloc::size_type;
-        using difference_type       = typename Alloc::difference_type;
-        using allocator_type        = Alloc;
-    private:
-        using byte_allocator_type   = typename Alloc::template rebind<uint8_t>::other;
-    public:
-
-        class Iter
-        {
-        public:
-            Iter(uint8_t* info_ptr, value_type* value_ptr): m_info_ptr(info_ptr), m_value_ptr(value_ptr) 
-            { 
-                if (*m_info_ptr == uint8_t(-1))
-                    operator++();
-            }
-            Iter(const Iter&)               = default;
-            ~Iter()                         = default;
-            Iter& operator=(const Iter&)    = default;
-
-            friend constexpr bool operator==(const Iter& lhs, const Iter& rhs) { return lhs.m_info_ptr == rhs.m_info_ptr; }
-            friend constexpr bool operator!=(const Iter& lhs, const Iter& rhs) { return !(lhs == rhs); }
-            Iter& operator++() 
-            {
-                advance_iter(m_info_ptr), advance_iter(m_value_ptr);
-                while (*m_info_ptr == uint8_t(-1))
-                    advance_iter(m_info_ptr), advance_iter(m_value_ptr);
-                return *this; 
-            }
-            const pointer operator->() const { return &*m_value_ptr; }
-            const_reference operator*() const { return *m_value_ptr; }
-        private:
-            friend class unordered_map;
-            value_type* m_value_ptr;
-            uint8_t* m_info_ptr;
-        };
-
-        friend class Iter;
-        using iterator              = Iter;
-
-        unordered_map(float load_factor = 0.75f, size_type inital_capacity = 128u, size_type growth_factor = 16u)
-            :LOAD_FACTOR(load_factor),
-            INITIAL_CAPACITY(closestPowerOfTwo(inital_capacity)),
-            GROWTH_FACTOR(closestPowerOfTwo(growth_factor)),
-            m_capacity(INITIAL_CAPACITY),
-            m_capacity_dec(INITIAL_CAPACITY - 1),
-            m_max_elems(size_type(INITIAL_CAPACITY* LOAD_FACTOR)),
-            m_size(0)
-        {
-            // +1 is for the differantiation of the end() iterator
-            m_info_bucket = m_allocator.allocate(m_capacity * ELEM_OFFSET + 1);
-
-            m_bucket = reinterpret_cast<value_type*>(m_info_bucket + 1);
-            auto iter = m_info_bucket;
-            for (; iter != end(m_info_bucket); advance_iter(iter))
-                *iter = uint8_t(-1);
-                
-            //Element at the end must have a non -1u info value
-            *iter = uint8_t(0);
-        }
-
-        ~unordered_map()
-        {
-            auto iter_info = m_info_bucket;
-            auto iter_bucket = m_bucket;
-            for (; iter_info != end(m_info_bucket); advance_iter(iter_info, iter_bucket))
-                    if (*iter_info != uint8_t(-1))
-                        iter_bucket->~value_type();
-            m_allocator.deallocate(m_info_bucket, m_capacity * ELEM_OFFSET + 1);
-        }
-
-        mapped_type& operator[](const key_type& key)
-        {
-            return const_cast<mapped_type&>(insert(value_type(key, mapped_type())).first->second);
-        }
-
-        iterator find(const key_type& key) const
-        {
-            auto idx = hashAndTrim(key);
-
-            // Distance from hash position
-            auto id = uint8_t(0);
-
-            auto iter_info = m_info_bucket;
-            auto iter_bucket = m_bucket;
-            advance_iter(iter_info, idx);
-            advance_iter(iter_bucket, idx);
-            while (true)
-            {
-                // Key not found
-                if (JVN_UNLIKELY(*iter_info == uint8_t(-1) || *iter_info < id))
-                    return end();
-
-                // Key found
-                if (*iter_info == id && key_equal{}(iter_bucket->first, key))
-                    return iterator(iter_info, iter_bucket);
-
-                ++id;
-                advance_iter(iter_info, iter_bucket);
-
-                // Check iterator bounds
-                if (JVN_UNLIKELY(iter_info == end(m_info_bucket)))
-                    iter_info = m_info_bucket, iter_bucket = m_bucket;
-            }
-        }
-
-        template <class Ty, std::enable_if_t<std::is_same<std::decay_t<Ty>, value_type>::value, int> = 0>
-        pair<iterator, bool> insert(Ty&& key_value_pair)
-        {
-            auto idx = hashAndTrim(key_value_pair.first);
-
-            // Distance from hash position
-            auto id = uint8_t(0);
-
-            // Original key
-            auto key = key_value_pair.first;
-
-            auto iter_info = m_info_bucket;
-            auto iter_bucket = m_bucket;
-            advance_iter(iter_info, idx);
-            advance_iter(iter_bucket, idx);
-            while (true)
-            {
-                // Found an empty slot
-                if (*iter_info == uint8_t(-1))
-                {
-                    *iter_info = id;
-                    ::new (iter_bucket) auto(std::forward<Ty>(key_value_pair));
-                    ++m_size;
-                    if (JVN_UNLIKELY(m_size == m_max_elems))
-                        grow();
-                    return pair<iterator, bool>(find(key), true);
-                }
-
-                // Key found
-                if (*iter_info == id && JVN_UNLIKELY(key_equal{}(iter_bucket->first, key_value_pair.first)))
-                    return pair<iterator, bool>(iterator(iter_info, iter_bucket), false);
-
-                // Swap rich with the poor
-                if (*iter_info < id)
-                {
-                    swap(*iter_bucket, key_value_pair);
-                    std::swap(*iter_info, id);
-                } 
-
-                ++id;
-                advance_iter(iter_info, iter_bucket);
-
-                // Check iterator bounds
-                if (JVN_UNLIKELY(iter_info == end(m_info_bucket)))
-                    iter_info = m_info_bucket, iter_bucket = m_bucket;
-            }
-        }
-
-        size_type erase(const key_type& key)
-        {
-            auto iter = find(key);
-
-            // Check if elem is in the table
-            if (iter == end())
-                return size_type(0);
-
-            // Traverse the bucket and swap elements with previous until
-            // an empty slot is found or an element with the 0 hash distance
-            auto iter_info = iter.m_info_ptr;
-            auto iter_bucket = iter.m_value_ptr;
-            auto iter_prev_info = iter_info;
-            auto iter_prev_bucket = iter_bucket;
-            advance_iter(iter_info, iter_bucket);
-            if (JVN_UNLIKELY(iter_info == end(m_info_bucket)))
-                    iter_info = m_info_bucket, iter_bucket = m_bucket;
-            while (*iter_info != uint8_t(0) && *iter_info != uint8_t(-1))
-            {
-                std::swap(*iter_prev_info, *iter_info);
-                swap(*iter_prev_bucket, *iter_bucket);
-                --(*iter_prev_info);
-                advance_iter(iter_prev_info, iter_prev_bucket, iter_info, iter_bucket);
-                if (JVN_UNLIKELY(iter_prev_info == end(m_info_bucket)))
-                    iter_prev_info = m_info_bucket, iter_prev_bucket = m_bucket;
-                if (JVN_UNLIKELY(iter_info == end(m_info_bucket)))
-                    iter_info = m_info_bucket, iter_bucket = m_bucket;
-            }
-
-            // Destroy the element
-            *iter_prev_info = uint8_t(-1);
-            iter_prev_bucket->~value_type();
-            --m_size;
-            return size_type(1);
-        }
-
-        size_type size() const noexcept { return m_size; }
-        bool empty() const noexcept { return !m_size; }
-
-
-        iterator begin() const { return iterator(m_info_bucket, m_bucket); }
-        iterator end() const { return iterator(end(m_info_bucket), nullptr); }
-
-    private:
-        // Number of bytes needed to advance a pointer for the next element
-        static JVN_INLINE_VAR constexpr size_type ELEM_OFFSET = 1 + sizeof(value_type);
-
-        const float LOAD_FACTOR;
-
-        // Must be power of 2 for optimal hash trimming
-        const size_type INITIAL_CAPACITY;
-        const size_type GROWTH_FACTOR;
-
-        // A decremented value of m_capacity used for hash trimming
-        size_type m_capacity_dec;
-        // The number of elements that triggers grow()
-        size_type m_max_elems;
-
-        size_type m_capacity, m_size;
-        value_type* m_bucket;
-        uint8_t* m_info_bucket;
-        byte_allocator_type m_allocator;
-
-        // Since m_capacity is always a power of two and m_capacity_dec is just its decremented value
-        // m_capacity_dec is all ones (1111....) binary, it can be used for fast trimming of the top bits
-        // of the hash. % is a very slow operation so this is a very desired optimisation
-        // Care : The hash fucntion needs to not be reliant on the top bits otherwise colisions number will
-        // increase
-        size_type hashAndTrim(const key_type& key) const noexcept { return hasher{}(key) & m_capacity_dec; }
-
-        // Grows the map and rehashes it
-        void grow()
-        {
-            auto prev_capacity = m_capacity;
-            auto prev_bucket = m_bucket;
-            auto prev_info_bucket = m_info_bucket;
-
-            // Grow the bucket
-            m_capacity = size_type(prev_capacity * GROWTH_FACTOR);
-            m_capacity_dec = m_capacity - 1;
-            m_max_elems = size_type(m_capacity * LOAD_FACTOR);
-            m_size = 0;
-            m_info_bucket = m_allocator.allocate(m_capacity * ELEM_OFFSET + 1);
-            m_bucket = reinterpret_cast<value_type*>(m_info_bucket + 1);
-            auto iter = m_info_bucket;
-            for (; iter != end(m_info_bucket); advance_iter(iter))
-                *iter = uint8_t(-1);
-            *iter = uint8_t(0);
-
-            // Rehash and insert
-            auto iter_info = prev_info_bucket;
-            auto iter_bucket = prev_bucket;
-            auto end_iter = prev_info_bucket;
-            advance_iter(end_iter, prev_capacity);
-            for (; iter_info != end_iter; advance_iter(iter_info, iter_bucket))
-                if (*iter_info != uint8_t(-1))
-                    insert(std::move(*iter_bucket));
-            m_allocator.deallocate(prev_info_bucket, prev_capacity * ELEM_OFFSET + 1);
-        }
-
-        // Returns the first equal or bigger power of two, return value is always greater than 1
-        static size_type closestPowerOfTwo(size_type num) noexcept
-        {
-            if (num < 2)
-                return 2u;
-            num--;
-            num |= num >> 1;
-            num |= num >> 2;
-            num |= num >> 4;
-            num |= num >> 8;
-            num |= num >> 16;
-            num++;
-            return num;
-        }
-
-        // When the pointer to the beggining of the bucket is passed it returns the pointer to the end
-        template <class Ty, std::enable_if_t<std::is_pointer<Ty>::value, int> = 0>
-        Ty constexpr end(Ty ptr) const noexcept { return advance_iter(ptr, m_capacity); }
-
-        // Advance pointer(s) by count elements
-        template <class Ty, std::enable_if_t<std::is_pointer<Ty>::value, int> = 0>
-        static constexpr Ty advance_iter(Ty& ptr, size_type count = 1) noexcept 
-        { return ptr = reinterpret_cast<Ty>(reinterpret_cast<int8_t*>(ptr) + count * ELEM_OFFSET); }
-        template <class ...Tn>
-        static constexpr void advance_iter(Tn&... rest) noexcept
-        { ignore(advance_iter(rest)...); }
-        template <class ...Tn>
-        static constexpr void ignore(Tn&&... rest) {}
-    };
-
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "utility.h"
+#include "hash.h"
+#include "layout.h"
+// std::allocator std::allocator_traits
+#include <memory>
+#if JVN(CXX17)
+// std::pmr::polymorphic_allocator
+#   include <memory_resource>
+#endif
+// std::forward_as_tuple
+#include <tuple>
+// std::iterator_traits std::distance
+#include <iterator>
+#include <vector>
+// std::length_error
+#include <stdexcept>
+// std::min
+#include <algorithm>
+// std::exception_ptr
+#include <exception>
+
+// Define JVN_MAP_COUNTERS before including to count the probes and shifts of the map operations,
+// reported by unordered_map::stats(). The counters aren't thread safe, not even for concurrent finds
+#ifdef JVN_MAP_COUNTERS
+#   define JVN_MAP_COUNT(statement) statement
+#else
+#   define JVN_MAP_COUNT(statement)
+#endif
+
+namespace jvn
+{
+
+    template <class Map>
+    class map_view;
+
+    template <class Kt, class Vt, class Hasher, class KeyEq, class Alloc, class Layout, bool StoreHash, class Storage>
+    class incremental_map;
+
+    template <class Kt, class Vt, size_t N, class Hasher, class KeyEq, class Alloc, class Layout, bool StoreHash, class Storage>
+    class small_map;
+
+    template <class Kt, class Vt, class Hasher, class KeyEq, class Alloc, class Layout>
+    class cache_map;
+
+    template <class Kt, class Vt, class Hasher, class KeyEq, class Alloc, class Layout, class Mutex>
+    class concurrent_map;
+
+    template <class Map>
+    struct parallel_ops;
+
+    // A snapshot of the state of an unordered_map, returned by unordered_map::stats()
+    struct map_stats
+    {
+        size_t capacity;
+        size_t size;
+        float load_factor;
+        float max_load_factor;
+
+        // The displacement of an element is its distance from the hash position, its info byte
+        size_t max_displacement;
+        double mean_displacement;
+        // The number of elements at each displacement, from 0 to max_displacement
+        std::vector<size_t> displacement_histogram;
+
+        size_t grow_count;
+        // The size of the bucket allocation plus what the Storage allocated, e.g. the node pool
+        size_t bytes_allocated;
+
+        // Only counted with JVN_MAP_COUNTERS defined, zero otherwise.
+        // A probe is a slot visited while searching for a key
+        size_t find_count;
+        size_t find_probe_count;
+        size_t insert_count;
+        size_t insert_probe_count;
+        // Elements moved by a slot to make room for an insert, the equivalent of Robin Hood swaps,
+        // or moved back to fill the slot of an erased element
+        size_t shift_count;
+    };
+
+    // An hashmap implementation, using the RobinHood algorithm.
+    // By default it should be noticably faster than std::unordered_map.
+
+    // The default memory layout is one byte containing the distance from the hash position
+    // followed by a key-value pair. The number of allocated elements is always 2^n in order for
+    // the hash to be optimaly trimmed to the size range of the bucket. The memory is allocated
+    // for the pairs but they are not constructed until a key key-value is inserted.
+    // The info byte is next to the pair in order to limit cache misses when accessing
+    // elements. The potential cache miss compared to the alignment difference ought to
+    // be more impactfull on the map's efficacy.
+    // For lookup heavy maps with long probe sequences or wide values jvn::separate_layout
+    // keeps the info bytes in their own array, where they're probed a group at a time (layout.h).
+    // Its iterators skip the empty slots a group at a time as well, worth it for sparse tables.
+    // The pairs of the default layout aren't aligned, jvn::grouped_layout keeps them aligned in
+    // blocks of info bytes followed by pairs, for types that need it e.g. atomics or SIMD members.
+    // With StoreHash the hash of each key is cached next to its pair, worth it for keys
+    // that are expensive to hash or compare e.g. long strings.
+    // Maps keyed by untrusted input should use jvn::seeded_hash (hash.h), the displacement limit
+    // below bounds the probe length but can't stop an attacker that knows the hash seed.
+    // With jvn::node_storage the slots hold pointers to pool allocated pairs instead of the pairs,
+    // see node_map below.
+    // Range reduces the hashes to slot indices (hash.h), by default the low bits are masked so the
+    // hash has to mix its bits into them. Integer and pointer keys can skip the hash finalizer with
+    // jvn::identity_hash, whose keys are spread by jvn::fibonacci_range or jvn::mix_range instead.
+    // Alloc is used through std::allocator_traits, rebound to bytes for the bucket. Large tables
+    // benefit from jvn::huge_page_allocator (allocator.h), arenas from the jvn::pmr aliases below.
+    // Nothing is allocated until the first insert, the bucket of INITIAL_CAPACITY slots is allocated
+    // by the first grow(). A map of only a few elements can keep them inline, see jvn::small_map.
+
+    template <class Kt, class Vt, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout, bool StoreHash = false, class Storage = flat_storage,
+        class Range = default_range_t<Hasher>>
+        class unordered_map
+    {
+    public:
+        using hasher                = Hasher;
+        // void for the table of an unordered_set (set.h), whose elements are the keys alone
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = std::conditional_t<std::is_void<Vt>::value, Kt, pair<Kt, Vt>>;
+        using pointer               = value_type*;
+        using reference             = value_type&;
+        using const_reference       = const value_type&;
+        using size_type             = typename std::allocator_traits<Alloc>::size_type;
+        using difference_type       = typename std::allocator_traits<Alloc>::difference_type;
+        using allocator_type        = Alloc;
+        using layout_type           = Layout;
+        using range_type            = Range;
+    private:
+        // The bucket is allocated in units of max_align_t instead of bytes, an allocator only aligns
+        // an array to its element type, e.g. the pmr allocators, and the layouts align the pairs
+        using bucket_unit           = std::max_align_t;
+        using bucket_allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<bucket_unit>;
+        using bucket_traits         = std::allocator_traits<bucket_allocator_type>;
+        using storage_type          = typename Storage::template storage<value_type, Alloc>;
+        using element_type          = typename storage_type::element_type;
+        using slot_type             = slot<element_type, StoreHash>;
+        using store_hash            = std::integral_constant<bool, StoreHash>;
+
+    public:
+
+        class Iter
+        {
+        public:
+            using iterator_category     = std::forward_iterator_tag;
+            using value_type            = typename unordered_map::value_type;
+            using difference_type       = typename unordered_map::difference_type;
+            using pointer               = typename unordered_map::pointer;
+            using reference             = typename unordered_map::const_reference;
+
+            Iter(uint8_t* info_bucket, size_type capacity, size_type idx)
+                :Iter(info_bucket, capacity, idx, capacity) {}
+            Iter(const Iter&)               = default;
+            ~Iter()                         = default;
+            Iter& operator=(const Iter&)    = default;
+
+            friend constexpr bool operator==(const Iter& lhs, const Iter& rhs) { return lhs.m_idx == rhs.m_idx; }
+            friend constexpr bool operator!=(const Iter& lhs, const Iter& rhs) { return !(lhs == rhs); }
+            Iter& operator++()
+            {
+                m_idx = nextTaken(m_info_bucket, m_capacity, m_idx + 1);
+                if (m_idx >= m_end)
+                    m_idx = m_capacity;
+                return *this;
+            }
+            const pointer operator->() const { return value(); }
+            const_reference operator*() const { return *value(); }
+        private:
+            friend class unordered_map;
+            uint8_t* m_info_bucket;
+            size_type m_capacity;
+            size_type m_idx;
+            // The slots from m_end on hold elements erase() wrapped around from the start of the
+            // bucket, they were already visited so the iterator stops before them
+            size_type m_end;
+
+            Iter(uint8_t* info_bucket, size_type capacity, size_type idx, size_type end)
+                :m_info_bucket(info_bucket), m_capacity(capacity), m_idx(nextTaken(info_bucket, capacity, idx)),
+                m_end(end)
+            {
+                if (m_idx >= m_end)
+                    m_idx = m_capacity;
+            }
+
+            value_type* value() const noexcept
+            { return &storage_type::get(Layout::template value<slot_type>(m_info_bucket, m_capacity, m_idx)->value); }
+        };
+
+        friend class Iter;
+        using iterator              = Iter;
+
+        friend class map_view<unordered_map>;
+        friend class incremental_map<Kt, Vt, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage>;
+        template <class K, class V, size_t N, class H, class E, class A, class L, bool S, class St>
+        friend class small_map;
+        template <class K, class V, class H, class E, class A, class L>
+        friend class cache_map;
+        template <class K, class V, class H, class E, class A, class L, class M>
+        friend class concurrent_map;
+        friend struct parallel_ops<unordered_map>;
+
+    private:
+        // Heterogeneous lookup is enabled when both the hasher and key_equal are transparent
+        template <class K>
+        using transparent_key = std::integral_constant<bool, is_transparent<Hasher>::value &&
+            is_transparent<KeyEq>::value && !std::is_convertible<K, iterator>::value>;
+    public:
+
+        unordered_map(float load_factor = 0.75f, size_type inital_capacity = 128u, size_type growth_factor = 16u,
+            const hasher& hash = hasher(), const key_equal& equal = key_equal(), const allocator_type& alloc = allocator_type())
+            :LOAD_FACTOR(load_factor),
+            INITIAL_CAPACITY(closest_power_of_two(inital_capacity)),
+            GROWTH_FACTOR(closest_power_of_two(growth_factor)),
+            m_capacity_dec(0),
+            m_max_elems(0),
+            m_range(1),
+            m_capacity(1),
+            m_size(0),
+            m_info_bucket(emptyBucket()),
+            m_allocator(alloc),
+            m_storage(alloc),
+            m_hasher(hash),
+            m_key_equal(equal)
+        {}
+
+        // Builds the map from a range with the table sized once for all of the elements.
+        // For input iterators the number of elements isn't known in advance and the map grows as usual
+        template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+        unordered_map(InputIt first, InputIt last, float load_factor = 0.75f, size_type growth_factor = 16u,
+            const allocator_type& alloc = allocator_type())
+            :unordered_map(load_factor, capacityFor(rangeSize(first, last), load_factor), growth_factor,
+                hasher(), key_equal(), alloc)
+        {
+            insert(first, last);
+        }
+
+        // Builds the map from the values, moving them out of the vector which is left empty
+        explicit unordered_map(std::vector<value_type>&& values, float load_factor = 0.75f, size_type growth_factor = 16u,
+            const allocator_type& alloc = allocator_type())
+            :unordered_map(load_factor, capacityFor(values.size(), load_factor), growth_factor,
+                hasher(), key_equal(), alloc)
+        {
+            reserve(values.size());
+            for (auto& key_value_pair : values)
+                emplaceUnchecked(std::move(key_value_pair));
+            values.clear();
+        }
+
+        ~unordered_map()
+        {
+            if (!m_owns_bucket)
+                return;
+            // An emptied table isn't walked, e.g. the old table of an incremental_map
+            for (auto idx = nextTaken(m_info_bucket, m_capacity, 0); m_size && idx != m_capacity;
+                idx = nextTaken(m_info_bucket, m_capacity, idx + 1))
+            {
+                destroyAt(idx);
+                --m_size;
+            }
+            deallocateBucket(m_info_bucket, m_capacity);
+        }
+
+        std::add_lvalue_reference_t<mapped_type> operator[](const key_type& key) { return try_emplace(key).first->second; }
+        std::add_lvalue_reference_t<mapped_type> operator[](key_type&& key) { return try_emplace(std::move(key)).first->second; }
+
+        // The key is only converted to key_type if it's not in the map
+        template <class K, std::enable_if_t<transparent_key<K>::value &&
+            !std::is_same<std::decay_t<K>, key_type>::value && std::is_constructible<key_type, K&&>::value, int> = 0>
+        std::add_lvalue_reference_t<mapped_type> operator[](K&& key)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)), std::tuple<>()).first->second;
+        }
+
+        iterator find(const key_type& key) const { return lookup(key); }
+
+        template <class K, std::enable_if_t<transparent_key<K>::value, int> = 0>
+        iterator find(const K& key) const { return lookup(key); }
+
+        bool contains(const key_type& key) const { return lookup(key) != end(); }
+
+        template <class K, std::enable_if_t<transparent_key<K>::value, int> = 0>
+        bool contains(const K& key) const { return lookup(key) != end(); }
+
+        size_type count(const key_type& key) const { return size_type(contains(key)); }
+
+        template <class K, std::enable_if_t<transparent_key<K>::value, int> = 0>
+        size_type count(const K& key) const { return size_type(contains(key)); }
+
+        template <class Ty, std::enable_if_t<std::is_same<std::decay_t<Ty>, value_type>::value, int> = 0>
+        pair<iterator, bool> insert(Ty&& key_value_pair)
+        {
+            return emplaceKey(keyOf(key_value_pair), std::forward<Ty>(key_value_pair));
+        }
+
+        // Constructs the pair from a key and a value in place if the key isn't in the map
+        template <class K, class V, std::enable_if_t<std::is_same<std::decay_t<K>, key_type>::value, int> = 0>
+        pair<iterator, bool> emplace(K&& key, V&& value)
+        {
+            return emplaceKey(key, std::forward<K>(key), std::forward<V>(value));
+        }
+
+        // Any other arguments are needed to construct the pair before its key is known
+        template <class... Args>
+        pair<iterator, bool> emplace(Args&&... args)
+        {
+            value_type key_value_pair(std::forward<Args>(args)...);
+            return emplaceKey(keyOf(key_value_pair), std::move(key_value_pair));
+        }
+
+        // Constructs the mapped value from args in place if the key isn't in the map,
+        // otherwise the args are left untouched
+        template <class... Args>
+        pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template <class... Args>
+        pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template <class M>
+        pair<iterator, bool> insert_or_assign(const key_type& key, M&& value)
+        {
+            auto result = try_emplace(key, std::forward<M>(value));
+            if (!result.second)
+                result.first->second = std::forward<M>(value);
+            return result;
+        }
+
+        template <class M>
+        pair<iterator, bool> insert_or_assign(key_type&& key, M&& value)
+        {
+            auto result = try_emplace(std::move(key), std::forward<M>(value));
+            if (!result.second)
+                result.first->second = std::forward<M>(value);
+            return result;
+        }
+
+        // Finds the keys of the range [first, last) and writes an iterator for each of them to out.
+        // The keys are hashed and their slots prefetched BATCH_SIZE at a time before any of them
+        // is probed, so the cache misses of the lookups overlap instead of following each other.
+        // The keys are either key_type or, with transparent lookup, any type the hasher accepts
+        template <class KeyIt, class OutIt>
+        OutIt find_batch(KeyIt first, KeyIt last, OutIt out) const
+        {
+            lookupBatch(first, last, [this, &out](size_type idx, bool found)
+                { *out++ = found ? iterator(m_info_bucket, m_capacity, idx) : end(); });
+            return out;
+        }
+
+        // Same as find_batch() but writes whether each key is in the map
+        template <class KeyIt, class OutIt>
+        OutIt contains_batch(KeyIt first, KeyIt last, OutIt out) const
+        {
+            lookupBatch(first, last, [&out](size_type, bool found) { *out++ = found; });
+            return out;
+        }
+
+        size_type erase(const key_type& key) { return eraseKey(key); }
+
+        template <class K, std::enable_if_t<transparent_key<K>::value, int> = 0>
+        size_type erase(const K& key) { return eraseKey(key); }
+
+        // Erases the element without looking its key up and returns the iterator of the next one.
+        // The elements after it are shifted back a slot, so the next one may be in the same slot.
+        // A shift that wraps around the end of the bucket moves the element of the first slot, which
+        // a loop from begin() already visited, into the last one, the returned iterator ends before
+        // it. So does the one returned by the next erase() after the shift moves it further back
+        iterator erase(iterator pos)
+        {
+            destroyAt(pos.m_idx);
+            auto vacated = shiftBackward(pos.m_idx);
+            --m_size;
+            auto end = pos.m_end;
+            if (vacated < pos.m_idx || vacated >= end)
+                --end;
+            return iterator(m_info_bucket, m_capacity, pos.m_idx, end);
+        }
+
+        // Erases the elements for which pred(const value_type&) returns true in a single pass over
+        // the bucket, returns the number of erased elements. Instead of a backward shift per erased
+        // element each kept element is moved back once, as far as the holes before it and its hash
+        // position allow. The pass starts after an empty slot so every cluster is compacted whole.
+        // If pred throws the cluster it's in is still compacted, the elements erased so far stay erased
+        template <class Pred>
+        size_type erase_if(Pred pred)
+        {
+            if (!m_size)
+                return size_type(0);
+            auto start = size_type(0);
+            while (info(start) != uint8_t(-1))
+                ++start;
+
+            // The first slot of the empty slots before idx that the kept elements can be moved to,
+            // m_capacity if there are none
+            auto hole = m_capacity;
+            auto erased = size_type(0);
+            std::exception_ptr error;
+            for (size_type count = 1; count <= m_capacity; ++count)
+            {
+                auto idx = (start + count) & m_capacity_dec;
+                if (info(idx) == uint8_t(-1))
+                {
+                    if (error)
+                        break;
+                    hole = m_capacity;
+                    continue;
+                }
+
+                auto remove = false;
+                if (!error)
+                {
+                    try
+                    {
+                        remove = pred(static_cast<const value_type&>(*bucket(idx)));
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+                if (remove)
+                {
+                    destroyAt(idx);
+                    info(idx) = uint8_t(-1);
+                    ++erased;
+                    if (hole == m_capacity)
+                        hole = idx;
+                    continue;
+                }
+                if (hole == m_capacity)
+                    continue;
+
+                // An element at its hash position stays, the holes before it are left empty
+                auto shift = std::min(size_type((idx - hole) & m_capacity_dec), size_type(info(idx)));
+                if (!shift)
+                {
+                    hole = m_capacity;
+                    continue;
+                }
+                auto idx_new = (idx - shift) & m_capacity_dec;
+                ::new (slotAt(idx_new)) slot_type(std::move(*slotAt(idx)));
+                slotAt(idx)->~slot_type();
+                info(idx_new) = uint8_t(info(idx) - shift);
+                info(idx) = uint8_t(-1);
+                hole = (idx_new + 1) & m_capacity_dec;
+                JVN_MAP_COUNT(++m_shift_count);
+            }
+            m_size -= erased;
+            if (error)
+                std::rethrow_exception(error);
+            return erased;
+        }
+
+        // Inserts the range, for forward iterators the table is grown at most once up front
+        // and the elements are inserted without the grow() check
+        template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+        void insert(InputIt first, InputIt last)
+        {
+            insertRange(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+        }
+
+        // Grows the table so count elements fit without a grow()
+        void reserve(size_type count)
+        {
+            if (!count)
+                return;
+            auto capacity = capacityFor(count, LOAD_FACTOR);
+            if (capacity > m_capacity)
+                rehashTo(capacity);
+        }
+
+        // Rehashes the table to the power of two capacity closest to bucket_count, or to the
+        // smallest capacity that holds the elements if that's greater. An empty map rehashed to 0
+        // frees its bucket, the next insert allocates one as a new map does
+        void rehash(size_type bucket_count)
+        {
+            if (!bucket_count && !m_size)
+            {
+                releaseBucket();
+                return;
+            }
+            auto capacity = closest_power_of_two(bucket_count);
+            auto capacity_min = capacityFor(m_size, LOAD_FACTOR);
+            if (capacity < capacity_min)
+                capacity = capacity_min;
+            if (capacity != m_capacity)
+                rehashTo(capacity);
+        }
+
+        // Shrinks the table to the smallest capacity that holds the elements, e.g. after mass erases
+        void shrink_to_fit() { rehash(0u); }
+
+        // The number of threads used by jvn::insert_parallel() and by grow(), rehash() and reserve()
+        // of large tables, set by jvn::set_thread_count() (parallel.h). 1 by default
+        size_type thread_count() const noexcept { return m_thread_count; }
+
+        size_type size() const noexcept { return m_size; }
+        bool empty() const noexcept { return !m_size; }
+        // 0 until the bucket is allocated
+        size_type bucket_count() const noexcept { return allocated() ? m_capacity : size_type(0); }
+        float load_factor() const noexcept { return float(m_size) / float(m_capacity); }
+        float max_load_factor() const noexcept { return LOAD_FACTOR; }
+        hasher hash_function() const { return m_hasher; }
+        key_equal key_eq() const { return m_key_equal; }
+        allocator_type get_allocator() const { return allocator_type(m_allocator); }
+
+        // Walks the whole table to collect the displacements, O(bucket_count())
+        map_stats stats() const
+        {
+            map_stats result{};
+            result.capacity = bucket_count();
+            result.size = m_size;
+            result.load_factor = load_factor();
+            result.max_load_factor = LOAD_FACTOR;
+
+            size_t total = 0;
+            for (size_type idx = 0; idx != m_capacity; ++idx)
+                if (info(idx) != uint8_t(-1))
+                {
+                    if (result.displacement_histogram.size() <= info(idx))
+                        result.displacement_histogram.resize(info(idx) + 1u);
+                    ++result.displacement_histogram[info(idx)];
+                    total += info(idx);
+                }
+            result.max_displacement = m_size ? result.displacement_histogram.size() - 1 : 0;
+            result.mean_displacement = m_size ? double(total) / double(m_size) : 0.0;
+
+            result.grow_count = m_grow_count;
+            result.bytes_allocated = (allocated() ? bucketUnits(m_capacity) * sizeof(bucket_unit) : size_t(0)) +
+                m_storage.bytes_allocated();
+#ifdef JVN_MAP_COUNTERS
+            result.find_count = m_find_count;
+            result.find_probe_count = m_find_probe_count;
+            result.insert_count = m_insert_count;
+            result.insert_probe_count = m_insert_probe_count;
+            result.shift_count = m_shift_count;
+#endif
+            return result;
+        }
+
+
+        iterator begin() const { return iterator(m_info_bucket, m_capacity, 0); }
+        iterator end() const { return iterator(m_info_bucket, m_capacity, m_capacity); }
+
+    private:
+        // An insert that would displace an element further than DISPLACEMENT_LIMIT from its hash position
+        // grows the table instead, which bounds the probe length of every lookup. Unless the table is
+        // sparse, since then the hashes themselves collide and growing doesn't spread them. The elements
+        // are then displaced up to MAX_DISPLACEMENT, the largest info byte value that isn't the empty marker
+        static JVN_INLINE_VAR constexpr uint8_t DISPLACEMENT_LIMIT = 128;
+        static JVN_INLINE_VAR constexpr uint8_t MAX_DISPLACEMENT = 0xfe;
+
+        // The number of keys find_batch() and contains_batch() prefetch before probing
+        static JVN_INLINE_VAR constexpr size_type BATCH_SIZE = 16;
+
+        // Smaller tables and ranges are rehashed and inserted on the calling thread
+        static JVN_INLINE_VAR constexpr size_type PARALLEL_MIN = size_type(1) << 16;
+
+        const float LOAD_FACTOR;
+
+        // Must be power of 2 for optimal hash trimming
+        const size_type INITIAL_CAPACITY;
+        const size_type GROWTH_FACTOR;
+
+        // A decremented value of m_capacity used for hash trimming
+        size_type m_capacity_dec;
+        // The number of elements that triggers grow()
+        size_type m_max_elems;
+        // Reduces a hash to its hash position, constructed with m_capacity
+        Range m_range;
+
+        size_type m_capacity, m_size;
+        // The single allocation holding the info bytes and the pairs, arranged by Layout.
+        // emptyBucket() with a capacity of 1 until the first insert
+        uint8_t* m_info_bucket;
+        bucket_allocator_type m_allocator;
+        // Empty unless the pairs are allocated in nodes
+        storage_type m_storage;
+        // Held since they may be stateful, e.g. seeded_hash
+        hasher m_hasher;
+        key_equal m_key_equal;
+
+        size_type m_grow_count = 0;
+        size_type m_thread_count = 1;
+        // parallel_ops::rehash() once jvn::set_thread_count() is given more than one thread
+        void (*m_rehash_parallel)(unordered_map&, size_type) = nullptr;
+        // False for the bucket of a map_view, which the map only reads
+        const bool m_owns_bucket = true;
+#ifdef JVN_MAP_COUNTERS
+        // Mutable since find() counts as well
+        mutable size_type m_find_count = 0, m_find_probe_count = 0;
+        size_type m_insert_count = 0, m_insert_probe_count = 0, m_shift_count = 0;
+#endif
+
+        // Takes over an empty bucket allocated with alloc and cleared by clearInfo(), for incremental_map
+        unordered_map(uint8_t* info_bucket, size_type capacity, float load_factor, size_type growth_factor,
+            const hasher& hash, const key_equal& equal, const allocator_type& alloc)
+            :LOAD_FACTOR(load_factor),
+            INITIAL_CAPACITY(capacity),
+            GROWTH_FACTOR(growth_factor),
+            m_capacity_dec(capacity - 1),
+            m_max_elems(size_type(capacity * load_factor)),
+            m_range(capacity),
+            m_capacity(capacity),
+            m_size(0),
+            m_info_bucket(info_bucket),
+            m_allocator(alloc),
+            m_storage(alloc),
+            m_hasher(hash),
+            m_key_equal(equal)
+        {}
+
+        // Wraps a bucket owned by a map_view, only the const member functions are called
+        unordered_map(uint8_t* info_bucket, size_type capacity, size_type size, float load_factor, const hasher& hash)
+            :LOAD_FACTOR(load_factor),
+            INITIAL_CAPACITY(capacity),
+            GROWTH_FACTOR(2u),
+            m_capacity_dec(capacity - 1),
+            m_max_elems(size_type(capacity * load_factor)),
+            m_range(capacity),
+            m_capacity(capacity),
+            m_size(size),
+            m_info_bucket(info_bucket),
+            m_hasher(hash),
+            m_owns_bucket(false)
+        {}
+
+        uint8_t& info(size_type idx) const noexcept { return *Layout::template info<slot_type>(m_info_bucket, m_capacity, idx); }
+        slot_type* slotAt(size_type idx) const noexcept { return Layout::template value<slot_type>(m_info_bucket, m_capacity, idx); }
+        value_type* bucket(size_type idx) const noexcept { return &storage_type::get(slotAt(idx)->value); }
+
+        // Destroys the element of a taken slot, the slot is then empty but its info byte isn't updated
+        void destroyAt(size_type idx) noexcept
+        {
+            m_storage.destroy(slotAt(idx)->value);
+            slotAt(idx)->~slot_type();
+        }
+
+        // The hash position of a hash, reduced by Range. Since m_capacity is always a power of two the
+        // default mask_range trims the top bits with m_capacity_dec, which is all ones (1111....) binary.
+        // % is a very slow operation so this is a very desired optimisation
+        // Care : The hash fucntion then needs to not be reliant on the top bits otherwise colisions number will
+        // increase
+        size_type trim(size_t hash) const noexcept { return size_type(m_range(hash)); }
+
+        // The number of slots visited by a probe from the hash position to idx
+        size_type probeLength(size_t hash, size_type idx) const noexcept { return ((idx - trim(hash)) & m_capacity_dec) + 1; }
+
+        // The hash of the slot's key, cached or computed
+        size_t hashOf(slot_type& s, std::true_type) const noexcept { return s.hash; }
+        size_t hashOf(slot_type& s, std::false_type) const { return m_hasher(keyOf(storage_type::get(s.value))); }
+
+        // The key of an element, the first of a pair or the element itself in a set. Also used for
+        // the pairs of an inserted range, which may be of another pair type
+        template <class Ty>
+        static const auto& keyOf(const Ty& element) noexcept { return keyOf(element, std::is_void<Vt>()); }
+        template <class Ty>
+        static const auto& keyOf(const Ty& element, std::false_type) noexcept { return element.first; }
+        template <class Ty>
+        static const Ty& keyOf(const Ty& element, std::true_type) noexcept { return element; }
+
+        // Compares the cached hash of the slot's key if there is one
+        static bool hashMatches(const slot_type& s, size_t hash, std::true_type) noexcept { return s.hash == hash; }
+        static bool hashMatches(const slot_type&, size_t, std::false_type) noexcept { return true; }
+
+        // Finds the iterator of key, which is either a key_type or a type the transparent
+        // hasher and key_equal accept
+        template <class K>
+        iterator lookup(const K& key) const { return lookup(key, m_hasher(key)); }
+
+        // The hash must be the one m_hasher computes for the key
+        template <class K>
+        iterator lookup(const K& key, size_t hash) const
+        {
+            auto idx = trim(hash);
+
+            // Distance from hash position
+            auto id = uint8_t(0);
+
+            auto found = probe(key, hash, idx, id);
+            JVN_MAP_COUNT(++m_find_count; m_find_probe_count += probeLength(hash, idx));
+            if (found)
+                return iterator(m_info_bucket, m_capacity, idx);
+            return end();
+        }
+
+        // Invokes func(idx, found) for every key of the range, in order
+        template <class KeyIt, class Func>
+        void lookupBatch(KeyIt first, KeyIt last, Func&& func) const
+        {
+            size_t hashes[BATCH_SIZE];
+            while (first != last)
+            {
+                // Hash and prefetch the batch
+                auto batch_first = first;
+                size_type count = 0;
+                for (; count != BATCH_SIZE && first != last; ++count, ++first)
+                {
+                    hashes[count] = m_hasher(*first);
+                    auto idx = trim(hashes[count]);
+                    JVN_PREFETCH(&info(idx));
+                    JVN_PREFETCH(slotAt(idx));
+                }
+
+                // Probe the batch
+                for (size_type i = 0; i != count; ++i, ++batch_first)
+                {
+                    auto idx = trim(hashes[i]);
+                    auto id = uint8_t(0);
+                    auto found = probe(*batch_first, hashes[i], idx, id);
+                    JVN_MAP_COUNT(++m_find_count; m_find_probe_count += probeLength(hashes[i], idx));
+                    func(idx, found);
+                }
+            }
+        }
+
+        template <class K>
+        size_type eraseKey(const K& key) { return eraseKey(key, m_hasher(key)); }
+
+        template <class K>
+        size_type eraseKey(const K& key, size_t hash)
+        {
+            auto iter = lookup(key, hash);
+
+            // Check if elem is in the table
+            if (iter == end())
+                return size_type(0);
+
+            destroyAt(iter.m_idx);
+            shiftBackward(iter.m_idx);
+            --m_size;
+            return size_type(1);
+        }
+
+        // Inserts the pair constructed from args if key isn't in the map. The key is hashed once
+        // and the returned iterator points to the slot the pair was constructed in
+        template <class K, class... Args>
+        pair<iterator, bool> emplaceKey(const K& key, Args&&... args)
+        {
+            return emplaceHashed(m_hasher(key), key, std::forward<Args>(args)...);
+        }
+
+        // emplaceKey() for a key already hashed by m_hasher, e.g. to pick a concurrent_map shard
+        template <class K, class... Args>
+        pair<iterator, bool> emplaceHashed(size_t hash, const K& key, Args&&... args)
+        {
+            auto idx = trim(hash);
+
+            // Distance from hash position
+            auto id = uint8_t(0);
+
+            // Key found
+            auto found = probe(key, hash, idx, id);
+            JVN_MAP_COUNT(++m_insert_count; m_insert_probe_count += probeLength(hash, idx));
+            if (JVN_UNLIKELY(found))
+                return pair<iterator, bool>(iterator(m_info_bucket, m_capacity, idx), false);
+
+            // Grow before placing the pair so the slot it's placed in stays valid
+            if (JVN_UNLIKELY(m_size + 1 >= m_max_elems))
+            {
+                while (m_size + 1 >= m_max_elems)
+                    grow();
+                idx = trim(hash);
+                id = uint8_t(0);
+                probe(absent_key{}, hash, idx, id);
+            }
+            ensurePlaceable(hash, idx, id);
+
+            placeNew(idx, id, hash, std::forward<Args>(args)...);
+            ++m_size;
+            return pair<iterator, bool>(iterator(m_info_bucket, m_capacity, idx), true);
+        }
+
+        // Grows the table while placing an element at idx would displace an element past
+        // DISPLACEMENT_LIMIT, idx and id are then the slot found by probing the new table.
+        // Throws std::length_error if even MAX_DISPLACEMENT would be exceeded in a sparse table
+        void ensurePlaceable(size_t hash, size_type& idx, uint8_t& id)
+        {
+            while (JVN_UNLIKELY(!placeable(idx, id, DISPLACEMENT_LIMIT)))
+            {
+                // Sparse table
+                if (m_size * 8 < m_capacity)
+                {
+                    if (!placeable(idx, id, MAX_DISPLACEMENT))
+                        throw std::length_error("jvn::unordered_map displacement overflow, too many equal hashes");
+                    return;
+                }
+
+                grow();
+                idx = trim(hash);
+                id = uint8_t(0);
+                probe(absent_key{}, hash, idx, id);
+            }
+        }
+
+        // Whether placing an element at idx and the distance id, shifting the cluster after it,
+        // keeps all of the distances at or below limit
+        bool placeable(size_type idx, uint8_t id, uint8_t limit) const noexcept
+        {
+            if (id > limit)
+                return false;
+            for (; info(idx) != uint8_t(-1); idx = (idx + 1) & m_capacity_dec)
+                if (info(idx) >= limit)
+                    return false;
+            return true;
+        }
+
+        // Places a new pair constructed from args, in the slot itself or in a node the slot points to
+        template <class... Args>
+        void placeNew(size_type idx, uint8_t id, size_t hash, Args&&... args)
+        {
+            placeNew(std::integral_constant<bool, storage_type::node_based>(), idx, id, hash, std::forward<Args>(args)...);
+        }
+        template <class... Args>
+        void placeNew(std::false_type, size_type idx, uint8_t id, size_t hash, Args&&... args)
+        {
+            place(idx, id, hash, std::forward<Args>(args)...);
+        }
+        // Placing the pointer doesn't throw, the node is created first
+        template <class... Args>
+        void placeNew(std::true_type, size_type idx, uint8_t id, size_t hash, Args&&... args)
+        {
+            place(idx, id, hash, m_storage.create(std::forward<Args>(args)...));
+        }
+
+        // Constructs an element from args in the slot idx at the distance id, the slot found by probe().
+        // If the slot is taken by a richer element it and the rest of its cluster are shifted one slot
+        // forward, which keeps the Robin Hood ordering the same as swapping the rich with the poor
+        // would, but moves every element only once and leaves the new element at idx
+        template <class... Args>
+        void place(size_type idx, uint8_t id, size_t hash, Args&&... args)
+        {
+            auto shifted = info(idx) != uint8_t(-1);
+            if (shifted)
+                shiftForward(idx);
+            try
+            {
+                ::new (slotAt(idx)) slot_type(hash, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                if (shifted)
+                    shiftBackward(idx);
+                else
+                    info(idx) = uint8_t(-1);
+                throw;
+            }
+            info(idx) = id;
+        }
+
+        // Moves the elements from idx up to the first empty slot one slot forward, leaving
+        // the slot idx without a constructed element
+        void shiftForward(size_type idx)
+        {
+            auto idx_empty = idx;
+            while (info(idx_empty) != uint8_t(-1))
+                idx_empty = (idx_empty + 1) & m_capacity_dec;
+
+            while (idx_empty != idx)
+            {
+                auto idx_prev = (idx_empty - 1) & m_capacity_dec;
+                ::new (slotAt(idx_empty)) slot_type(std::move(*slotAt(idx_prev)));
+                slotAt(idx_prev)->~slot_type();
+                info(idx_empty) = uint8_t(info(idx_prev) + 1);
+                idx_empty = idx_prev;
+                JVN_MAP_COUNT(++m_shift_count);
+            }
+        }
+
+        // The slot idx has no constructed element, move the elements after it one slot back until
+        // an empty slot is found or an element with the 0 hash distance. Returns the slot left empty,
+        // it's before idx when the shift wrapped around the end of the bucket
+        size_type shiftBackward(size_type idx)
+        {
+            auto idx_prev = idx;
+            idx = (idx + 1) & m_capacity_dec;
+            while (info(idx) != uint8_t(0) && info(idx) != uint8_t(-1))
+            {
+                ::new (slotAt(idx_prev)) slot_type(std::move(*slotAt(idx)));
+                slotAt(idx)->~slot_type();
+                info(idx_prev) = uint8_t(info(idx) - 1);
+                idx_prev = idx;
+                JVN_MAP_COUNT(++m_shift_count);
+                idx = (idx + 1) & m_capacity_dec;
+            }
+            info(idx_prev) = uint8_t(-1);
+            return idx_prev;
+        }
+
+        // Passed to probe() in place of a key that's known not to be in the map, e.g. when rehashing,
+        // so only the slot the key belongs to is searched for
+        struct absent_key {};
+
+        template <class K>
+        bool keyMatches(size_type idx, const K& key, size_t hash) const
+        { return hashMatches(*slotAt(idx), hash, store_hash()) && m_key_equal(keyOf(*bucket(idx)), key); }
+        bool keyMatches(size_type, absent_key, size_t) const noexcept { return false; }
+
+        // Walks the probe sequence of key from the slot idx at the distance id.
+        // Returns true if the key is found, idx is then the slot of the key. Otherwise idx and id
+        // are left on the first slot that's empty or closer to its hash position, i.e. where the key belongs
+        template <class K>
+        bool probe(const K& key, size_t hash, size_type& idx, uint8_t& id) const
+        {
+            while (true)
+            {
+                // Rule out a whole group of slots with a single comparison while the group doesn't
+                // wrap around the end of the bucket
+                if (Layout::contiguous_info && idx + info_group::WIDTH <= m_capacity && id <= info_group::MAX_ID)
+                {
+                    info_group group(&info(idx));
+                    auto stop = group.stop(id);
+                    auto match = group.match(id);
+
+                    // Only the matches before the first stop are part of the probe sequence
+                    if (stop)
+                        match &= (stop ^ (stop - 1)) >> 1;
+                    for (; match; match &= match - 1)
+                    {
+                        auto idx_match = idx + countr_zero(match);
+                        if (keyMatches(idx_match, key, hash))
+                            return idx = idx_match, true;
+                    }
+
+                    if (stop)
+                    {
+                        auto offset = countr_zero(stop);
+                        idx += offset;
+                        id = uint8_t(id + offset);
+                        return false;
+                    }
+
+                    id = uint8_t(id + info_group::WIDTH);
+                    idx = (idx + info_group::WIDTH) & m_capacity_dec;
+                    continue;
+                }
+
+                // Key not found
+                if (JVN_UNLIKELY(info(idx) == uint8_t(-1) || info(idx) < id))
+                    return false;
+
+                // Key found
+                if (info(idx) == id && keyMatches(idx, key, hash))
+                    return true;
+
+                ++id;
+                idx = (idx + 1) & m_capacity_dec;
+            }
+        }
+
+        // The bucket of a map that hasn't allocated one, a single empty slot and the end byte shared
+        // by all of the maps of the type. It's never written, since with m_max_elems at 0 the first
+        // insert grows the map before placing an element
+        static uint8_t* emptyBucket() noexcept
+        {
+            struct bucket
+            {
+                bucket() noexcept { clearInfo(bytes, 1, 0, 1); }
+                alignas(slot_type) uint8_t bytes[Layout::template allocation_size<slot_type>(1)];
+            };
+            static bucket empty;
+            return empty.bytes;
+        }
+
+        bool allocated() const noexcept { return m_info_bucket != emptyBucket(); }
+
+        // The first slot from idx on that holds an element, capacity if there is none. With contiguous
+        // info bytes the runs of empty slots are skipped a group at a time, so a sparse table, e.g.
+        // after mass erases, is walked without reading the cache lines of its empty slots
+        static size_type nextTaken(uint8_t* info_bucket, size_type capacity, size_type idx) noexcept
+        {
+            if (Layout::contiguous_info)
+                for (; idx + info_group::WIDTH <= capacity; idx += info_group::WIDTH)
+                {
+                    auto taken = info_group(Layout::template info<slot_type>(info_bucket, capacity, idx)).taken();
+                    if (taken)
+                        return idx + size_type(countr_zero(taken));
+                }
+            // The info byte past the last slot is never empty
+            while (*Layout::template info<slot_type>(info_bucket, capacity, idx) == uint8_t(-1))
+                ++idx;
+            return idx;
+        }
+
+        // Allocates a bucket with all of the slots empty
+        uint8_t* allocateBucket(size_type capacity)
+        {
+            auto info_bucket = allocateRaw(capacity);
+            clearInfo(info_bucket, capacity, 0, capacity);
+            return info_bucket;
+        }
+
+        void deallocateBucket(uint8_t* info_bucket, size_type capacity) noexcept
+        {
+            if (info_bucket != emptyBucket())
+                deallocateRaw(info_bucket, capacity);
+        }
+
+        // Allocates a bucket without clearing its info bytes
+        uint8_t* allocateRaw(size_type capacity)
+        {
+            return reinterpret_cast<uint8_t*>(bucket_traits::allocate(m_allocator, bucketUnits(capacity)));
+        }
+
+        void deallocateRaw(uint8_t* info_bucket, size_type capacity) noexcept
+        {
+            bucket_traits::deallocate(m_allocator, reinterpret_cast<bucket_unit*>(info_bucket), bucketUnits(capacity));
+        }
+
+        static size_type bucketUnits(size_type capacity) noexcept
+        {
+            return size_type((Layout::template allocation_size<slot_type>(capacity) + sizeof(bucket_unit) - 1) / sizeof(bucket_unit));
+        }
+
+        // Makes the bucket the table's, allocated before so a throwing allocation leaves the map as it was
+        void setBucket(uint8_t* info_bucket, size_type capacity) noexcept
+        {
+            m_info_bucket = info_bucket;
+            m_capacity = capacity;
+            m_capacity_dec = m_capacity - 1;
+            m_max_elems = size_type(m_capacity * LOAD_FACTOR);
+            m_range = Range(m_capacity);
+        }
+
+        // Returns an empty map to the state of a new one, without a bucket
+        void releaseBucket() noexcept
+        {
+            deallocateBucket(m_info_bucket, m_capacity);
+            m_info_bucket = emptyBucket();
+            m_capacity = 1;
+            m_capacity_dec = 0;
+            m_max_elems = 0;
+            m_range = Range(1);
+        }
+
+        // Marks the slots [first, last) of a bucket empty, and sets the info byte past the last
+        // slot once last reaches the capacity
+        static void clearInfo(uint8_t* info_bucket, size_type capacity, size_type first, size_type last) noexcept
+        {
+            for (size_type idx = first; idx != last; ++idx)
+                *Layout::template info<slot_type>(info_bucket, capacity, idx) = uint8_t(-1);
+
+            // Element at the end must have a non -1u info value
+            if (last == capacity)
+                *Layout::template info<slot_type>(info_bucket, capacity, capacity) = uint8_t(0);
+        }
+
+        template <class InputIt>
+        void insertRange(InputIt first, InputIt last, std::forward_iterator_tag)
+        {
+            reserve(m_size + size_type(std::distance(first, last)));
+            for (; first != last; ++first)
+                emplaceUnchecked(*first);
+        }
+
+        template <class InputIt>
+        void insertRange(InputIt first, InputIt last, std::input_iterator_tag)
+        {
+            for (; first != last; ++first)
+                insert(*first);
+        }
+
+        // Inserts a pair into a table that was sized for it beforehand, skipping the grow() check
+        template <class Ty>
+        void emplaceUnchecked(Ty&& key_value_pair)
+        {
+            emplaceUnchecked(m_hasher(keyOf(key_value_pair)), std::forward<Ty>(key_value_pair));
+        }
+
+        template <class Ty>
+        void emplaceUnchecked(size_t hash, Ty&& key_value_pair)
+        {
+            auto idx = trim(hash);
+            auto id = uint8_t(0);
+            if (probe(keyOf(key_value_pair), hash, idx, id))
+                return;
+            ensurePlaceable(hash, idx, id);
+            placeNew(idx, id, hash, std::forward<Ty>(key_value_pair));
+            ++m_size;
+        }
+
+        // Places a pair whose key isn't in the map without the grow() check on the size
+        template <class... Args>
+        size_type placeUnique(size_t hash, Args&&... args)
+        {
+            auto idx = trim(hash);
+            auto id = uint8_t(0);
+            probe(absent_key{}, hash, idx, id);
+            ensurePlaceable(hash, idx, id);
+            placeNew(idx, id, hash, std::forward<Args>(args)...);
+            ++m_size;
+            return idx;
+        }
+
+        // Moves the element of the taken slot idx to other, which must not hold its key. The slot
+        // is refilled by the shift of the elements after it, the slots before it aren't touched
+        void moveSlotTo(size_type idx, unordered_map& other)
+        {
+            other.placeUnique(hashOf(*slotAt(idx), store_hash()), std::move(*bucket(idx)));
+            destroyAt(idx);
+            shiftBackward(idx);
+            --m_size;
+        }
+
+        // Grows the map and rehashes it, the first grow() allocates the initial bucket
+        void grow()
+        {
+            if (!allocated())
+            {
+                rehashTo(INITIAL_CAPACITY);
+                return;
+            }
+            ++m_grow_count;
+            rehashTo(size_type(m_capacity * GROWTH_FACTOR));
+        }
+
+        // Moves the elements to a new bucket of the given capacity, which must hold all of them.
+        // The table grows past it if an element doesn't fit, see placeRehashed(). If hashing or
+        // moving an element throws, the elements not moved yet are destroyed with the old bucket.
+        // Large tables of a map with more than one thread are rehashed by parallel_ops (parallel.h)
+        void rehashTo(size_type capacity)
+        {
+            if (m_rehash_parallel && capacity >= PARALLEL_MIN)
+            {
+                m_rehash_parallel(*this, capacity);
+                return;
+            }
+            auto prev_capacity = m_capacity;
+            auto prev_info_bucket = m_info_bucket;
+            setBucket(allocateBucket(capacity), capacity);
+
+            // Counted back up as the elements are placed
+            auto count = m_size;
+            m_size = 0;
+            auto idx = nextTaken(prev_info_bucket, prev_capacity, 0);
+            try
+            {
+                // Rehash and insert, the keys are unique so they're never compared
+                for (; idx != prev_capacity; idx = nextTaken(prev_info_bucket, prev_capacity, idx + 1))
+                {
+                    auto prev_slot = Layout::template value<slot_type>(prev_info_bucket, prev_capacity, idx);
+                    placeRehashed(hashOf(*prev_slot, store_hash()), count, std::move(prev_slot->value));
+                    prev_slot->~slot_type();
+                    ++m_size;
+                }
+            }
+            catch (...)
+            {
+                releasePrevious(prev_info_bucket, prev_capacity, idx);
+                throw;
+            }
+            deallocateBucket(prev_info_bucket, prev_capacity);
+        }
+
+        // Places an element moved by a rehash of count elements. As in ensurePlaceable() the table
+        // grows while the element would displace an element past DISPLACEMENT_LIMIT, or past
+        // MAX_DISPLACEMENT once the table is sparse for count elements, but instead of throwing
+        // it keeps growing since the element has to be placed. The old table held the elements
+        // within MAX_DISPLACEMENT, so this only grows past its capacity when shrinking
+        template <class Ty>
+        void placeRehashed(size_t hash, size_type count, Ty&& element)
+        {
+            auto idx = trim(hash);
+            auto id = uint8_t(0);
+            probe(absent_key{}, hash, idx, id);
+            while (JVN_UNLIKELY(!placeable(idx, id, count * 8 < m_capacity ? MAX_DISPLACEMENT : DISPLACEMENT_LIMIT)))
+            {
+                rehashTo(size_type(m_capacity * 2));
+                idx = trim(hash);
+                id = uint8_t(0);
+                probe(absent_key{}, hash, idx, id);
+            }
+            place(idx, id, hash, std::forward<Ty>(element));
+        }
+
+        // Destroys the elements left in an old bucket from the slot idx on and frees it, for a
+        // rehash that threw
+        void releasePrevious(uint8_t* info_bucket, size_type capacity, size_type idx) noexcept
+        {
+            for (idx = nextTaken(info_bucket, capacity, idx); idx != capacity; idx = nextTaken(info_bucket, capacity, idx + 1))
+            {
+                auto prev_slot = Layout::template value<slot_type>(info_bucket, capacity, idx);
+                m_storage.destroy(prev_slot->value);
+                prev_slot->~slot_type();
+            }
+            deallocateBucket(info_bucket, capacity);
+        }
+
+        // The smallest capacity that holds count elements without triggering grow()
+        static size_type capacityFor(size_type count, float load_factor) noexcept
+        {
+            auto capacity = closest_power_of_two(size_type(count / load_factor) + 1);
+            while (size_type(capacity * load_factor) <= count)
+                capacity *= 2;
+            return capacity;
+        }
+
+        // The number of elements in a range, 0 if it can only be traversed once
+        template <class InputIt>
+        static size_type rangeSize(InputIt first, InputIt last)
+        {
+            return rangeSize(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+        }
+        template <class InputIt>
+        static size_type rangeSize(InputIt first, InputIt last, std::forward_iterator_tag)
+        { return size_type(std::distance(first, last)); }
+        template <class InputIt>
+        static size_type rangeSize(InputIt, InputIt, std::input_iterator_tag) { return 0u; }
+    };
+
+    // An unordered_map of pointers to pool allocated pairs and the hashes of their keys, for large
+    // or non-movable values. The probes compare the cached hashes and only dereference the pointer
+    // of a matching hash, the shifts and grow() move a pointer and a hash instead of a pair, and the
+    // references to the pairs stay valid until they're erased. The cost is an allocation per pair
+    // (amortized by the pool) and an indirection per access.
+    template <class Kt, class Vt, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout, bool StoreHash = true>
+    using node_map = unordered_map<Kt, Vt, Hasher, KeyEq, Alloc, Layout, StoreHash, node_storage>;
+
+#if JVN(CXX17)
+    namespace pmr
+    {
+        // An unordered_map allocating from a std::pmr::memory_resource, e.g. a monotonic arena
+        // that frees the whole table at once:
+        //     std::pmr::monotonic_buffer_resource arena;
+        //     jvn::pmr::unordered_map<int, int> table(0.75f, 128u, 16u, {}, {}, &arena);
+        template <class Kt, class Vt, class Hasher = hash<Kt>, class KeyEq = equal_to<Kt>,
+            class Layout = interleaved_layout, bool StoreHash = false, class Storage = flat_storage>
+        using unordered_map = jvn::unordered_map<Kt, Vt, Hasher, KeyEq,
+            std::pmr::polymorphic_allocator<pair<Kt, Vt>>, Layout, StoreHash, Storage>;
+
+        template <class Kt, class Vt, class Hasher = hash<Kt>, class KeyEq = equal_to<Kt>,
+            class Layout = interleaved_layout, bool StoreHash = true>
+        using node_map = jvn::node_map<Kt, Vt, Hasher, KeyEq,
+            std::pmr::polymorphic_allocator<pair<Kt, Vt>>, Layout, StoreHash>;
+    } // namespace pmr
+#endif
+
 } // namespace jvn
\ No newline at end of file
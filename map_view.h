@@ -0,0 +1,321 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+// std::FILE std::fopen std::fwrite
+#include <cstdio>
+// std::calloc std::free
+#include <cstdlib>
+// std::memcpy std::memcmp
+#include <cstring>
+// std::system_error std::generic_category
+#include <system_error>
+// errno
+#include <cerrno>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+namespace jvn
+{
+
+    // The header of a saved map, followed by the bucket at bucket_offset. The fields describing the
+    // slots must match the map type a file is opened as, the file is only portable between builds
+    // with the same pair layout and the same hash function.
+    struct map_file_header
+    {
+        char magic[8];
+        uint32_t version;
+        // Layout::id, with the id of the Range in the top byte
+        uint32_t layout;
+        uint32_t bitness;
+        uint32_t store_hash;
+        uint64_t slot_size;
+        uint64_t slot_align;
+        uint64_t capacity;
+        uint64_t size;
+        double max_load_factor;
+        // The seed of a seeded_hash, 0 for the stateless hashes
+        uint64_t seed;
+        // The hash of the first key in the bucket, a file saved with a different hash function
+        // (or version of it) would find nothing
+        uint64_t hash_check;
+        uint64_t bucket_offset;
+        uint64_t bucket_size;
+    };
+
+    // Reads and restores the seed of a hash with a seed member, e.g. seeded_hash
+    template <class Hash, class = void>
+    struct hash_seed
+    {
+        static uint64_t get(const Hash&) noexcept { return 0; }
+        static Hash make(uint64_t) { return Hash(); }
+    };
+
+    template <class Hash>
+    struct hash_seed<Hash, decltype(void(std::declval<Hash&>().seed))>
+    {
+        static uint64_t get(const Hash& hash) noexcept { return uint64_t(hash.seed); }
+        static Hash make(uint64_t seed) { return Hash(size_t(seed)); }
+    };
+
+    // A read only view of an unordered_map saved to a file, the file is memory mapped and the
+    // lookups run directly on the mapped bucket. Opening a view costs no rebuild, the pages are
+    // loaded on first access and the processes mapping the same file share them in the page cache.
+    // Only for maps of trivially copyable keys and values stored in the slots (not node_map).
+
+    // Map is the unordered_map type the file was saved from, e.g.
+    //     jvn::save_map(table, "table.jvn");
+    //     jvn::map_view<decltype(table)> view("table.jvn");
+    // Saving and opening throw std::system_error on I/O errors and opening throws
+    // std::invalid_argument if the file doesn't match the Map type.
+    template <class Map>
+    class map_view
+    {
+        static_assert(std::is_trivially_copyable<typename Map::key_type>::value &&
+            std::is_trivially_copyable<typename Map::mapped_type>::value,
+            "Only maps of trivially copyable keys and values can be saved");
+        static_assert(!Map::storage_type::node_based, "The pairs of a node_map aren't in the bucket");
+
+    public:
+        using map_type              = Map;
+        using hasher                = typename Map::hasher;
+        using mapped_type           = typename Map::mapped_type;
+        using key_type              = typename Map::key_type;
+        using key_equal             = typename Map::key_equal;
+        using value_type            = typename Map::value_type;
+        using size_type             = typename Map::size_type;
+        using iterator              = typename Map::iterator;
+
+        static JVN_INLINE_VAR constexpr uint32_t FILE_VERSION = 1;
+
+        explicit map_view(const char* path)
+        {
+            mapFile(path);
+            try
+            {
+                auto& header = *reinterpret_cast<const map_file_header*>(m_data);
+                // The sizes are checked by subtraction, a corrupted header can't wrap the sum around
+                if (m_length < BUCKET_OFFSET || !matches(header) || header.bucket_offset != BUCKET_OFFSET ||
+                    header.bucket_size > m_length - BUCKET_OFFSET || header.size > header.capacity)
+                    throw std::invalid_argument("jvn::map_view: the file doesn't hold a map of this type");
+
+                auto info_bucket = const_cast<uint8_t*>(m_data) + header.bucket_offset;
+                ::new (static_cast<void*>(m_map)) Map(info_bucket, size_type(header.capacity), size_type(header.size),
+                    float(header.max_load_factor), hash_seed<hasher>::make(header.seed));
+                if (hashCheck(map()) != header.hash_check)
+                {
+                    map().~Map();
+                    throw std::invalid_argument("jvn::map_view: the file was saved with a different hash function");
+                }
+            }
+            catch (...)
+            {
+                unmapFile();
+                throw;
+            }
+        }
+
+        map_view(const map_view&) = delete;
+        map_view& operator=(const map_view&) = delete;
+
+        ~map_view()
+        {
+            map().~Map();
+            unmapFile();
+        }
+
+        // Writes the header and the bucket of map to path, overwriting the file
+        static void save(const Map& map, const char* path)
+        {
+            auto bucket_size = Map::layout_type::template allocation_size<typename Map::slot_type>(map.m_capacity);
+
+            map_file_header header{};
+            std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = FILE_VERSION;
+            fillType(header);
+            header.capacity = map.m_capacity;
+            header.size = map.m_size;
+            header.max_load_factor = map.LOAD_FACTOR;
+            header.seed = hash_seed<hasher>::get(map.m_hasher);
+            header.hash_check = hashCheck(map);
+            header.bucket_offset = BUCKET_OFFSET;
+            header.bucket_size = bucket_size;
+
+            // The bucket is copied so the bytes of the empty slots are written as zeros instead of
+            // whatever the allocation held, calloc leaves the pages untouched until they're written
+            auto bucket = static_cast<uint8_t*>(std::calloc(bucket_size, 1));
+            if (!bucket)
+                throw std::bad_alloc();
+            for (size_type idx = 0; idx != map.m_capacity; ++idx)
+            {
+                *Map::layout_type::template info<typename Map::slot_type>(bucket, map.m_capacity, idx) = map.info(idx);
+                if (map.info(idx) != uint8_t(-1))
+                    std::memcpy(static_cast<void*>(Map::layout_type::template value<typename Map::slot_type>(bucket, map.m_capacity, idx)),
+                        map.slotAt(idx), sizeof(typename Map::slot_type));
+            }
+            *Map::layout_type::template info<typename Map::slot_type>(bucket, map.m_capacity, map.m_capacity) = uint8_t(0);
+
+            auto file = std::fopen(path, "wb");
+            if (!file)
+            {
+                std::free(bucket);
+                throw std::system_error(errno, std::generic_category(), "jvn::map_view::save: can't open the file");
+            }
+            char padding[BUCKET_OFFSET - sizeof(map_file_header)] = {};
+            auto written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                std::fwrite(padding, sizeof(padding), 1, file) == 1 &&
+                std::fwrite(bucket, 1, bucket_size, file) == bucket_size;
+            auto error = errno;
+            std::free(bucket);
+            if (std::fclose(file) != 0 || !written)
+                throw std::system_error(written ? errno : error, std::generic_category(), "jvn::map_view::save: can't write the file");
+        }
+
+        iterator find(const key_type& key) const { return map().find(key); }
+
+        template <class K>
+        iterator find(const K& key) const { return map().find(key); }
+
+        bool contains(const key_type& key) const { return map().contains(key); }
+
+        template <class K>
+        bool contains(const K& key) const { return map().contains(key); }
+
+        size_type count(const key_type& key) const { return map().count(key); }
+
+        template <class KeyIt, class OutIt>
+        OutIt find_batch(KeyIt first, KeyIt last, OutIt out) const { return map().find_batch(first, last, out); }
+
+        template <class KeyIt, class OutIt>
+        OutIt contains_batch(KeyIt first, KeyIt last, OutIt out) const { return map().contains_batch(first, last, out); }
+
+        size_type size() const noexcept { return map().size(); }
+        bool empty() const noexcept { return map().empty(); }
+        size_type bucket_count() const noexcept { return map().bucket_count(); }
+        float load_factor() const noexcept { return map().load_factor(); }
+        hasher hash_function() const { return map().hash_function(); }
+        key_equal key_eq() const { return map().key_eq(); }
+
+        iterator begin() const { return map().begin(); }
+        iterator end() const { return map().end(); }
+
+    private:
+        static JVN_INLINE_VAR constexpr char MAGIC[8] = { 'j', 'v', 'n', 'm', 'a', 'p', '\0', '\0' };
+        // The bucket starts on a cache line, the mapping itself is page aligned
+        static JVN_INLINE_VAR constexpr size_t BUCKET_OFFSET = 128;
+        static_assert(sizeof(map_file_header) < BUCKET_OFFSET, "The header must fit before the bucket");
+
+        // The map wrapping the mapped bucket, constructed once the header is checked
+        alignas(Map) unsigned char m_map[sizeof(Map)];
+        const uint8_t* m_data = nullptr;
+        size_t m_length = 0;
+#ifdef _WIN32
+        HANDLE m_mapping = nullptr;
+#endif
+
+        const Map& map() const noexcept { return *reinterpret_cast<const Map*>(m_map); }
+        Map& map() noexcept { return *reinterpret_cast<Map*>(m_map); }
+
+        static void fillType(map_file_header& header) noexcept
+        {
+            // The range is in the top byte, the default mask_range is 0
+            header.layout = Map::layout_type::id | Map::range_type::id << 24;
+            header.bitness = JVN(BITNESS);
+            header.store_hash = Map::store_hash::value;
+            header.slot_size = sizeof(typename Map::slot_type);
+            header.slot_align = alignof(typename Map::slot_type);
+        }
+
+        static bool matches(const map_file_header& header) noexcept
+        {
+            map_file_header expected{};
+            fillType(expected);
+            return !std::memcmp(header.magic, MAGIC, sizeof(header.magic)) && header.version == FILE_VERSION &&
+                header.layout == expected.layout && header.bitness == expected.bitness &&
+                header.store_hash == expected.store_hash && header.slot_size == expected.slot_size &&
+                header.slot_align == expected.slot_align && header.capacity && !(header.capacity & (header.capacity - 1)) &&
+                header.bucket_size == Map::layout_type::template allocation_size<typename Map::slot_type>(size_t(header.capacity));
+        }
+
+        static uint64_t hashCheck(const Map& map)
+        {
+            auto first = map.begin();
+            return first == map.end() ? 0 : uint64_t(map.m_hasher(first->first));
+        }
+
+#ifdef _WIN32
+        void mapFile(const char* path)
+        {
+            auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                throw std::system_error(int(GetLastError()), std::system_category(), "jvn::map_view: can't open the file");
+            LARGE_INTEGER length;
+            if (!GetFileSizeEx(file, &length) ||
+                !(m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)))
+            {
+                auto error = GetLastError();
+                CloseHandle(file);
+                throw std::system_error(int(error), std::system_category(), "jvn::map_view: can't map the file");
+            }
+            CloseHandle(file);
+            m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (!m_data)
+            {
+                auto error = GetLastError();
+                CloseHandle(m_mapping);
+                throw std::system_error(int(error), std::system_category(), "jvn::map_view: can't map the file");
+            }
+            m_length = size_t(length.QuadPart);
+        }
+
+        void unmapFile() noexcept
+        {
+            UnmapViewOfFile(m_data);
+            CloseHandle(m_mapping);
+        }
+#else
+        void mapFile(const char* path)
+        {
+            auto fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "jvn::map_view: can't open the file");
+            struct stat st;
+            auto error = ::fstat(fd, &st) != 0 ? errno : st.st_size == 0 ? EINVAL : 0;
+            if (error)
+            {
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "jvn::map_view: can't map the file");
+            }
+            m_length = size_t(st.st_size);
+            auto data = ::mmap(nullptr, m_length, PROT_READ, MAP_SHARED, fd, 0);
+            error = errno;
+            // The mapping stays valid after the descriptor is closed
+            ::close(fd);
+            if (data == MAP_FAILED)
+                throw std::system_error(error, std::generic_category(), "jvn::map_view: can't map the file");
+            m_data = static_cast<const uint8_t*>(data);
+        }
+
+        void unmapFile() noexcept { ::munmap(const_cast<uint8_t*>(m_data), m_length); }
+#endif
+    };
+
+#if !JVN(CXX17)
+    template <class Map>
+    constexpr char map_view<Map>::MAGIC[8];
+#endif
+
+    // Saves map to path, to be opened with map_view<Map>
+    template <class Map>
+    void save_map(const Map& map, const char* path) { map_view<Map>::save(map, path); }
+
+} // namespace jvn
@@ -0,0 +1,393 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+// std::thread
+#include <thread>
+// std::mutex std::lock_guard
+#include <mutex>
+// std::atomic
+#include <atomic>
+// std::system_error
+#include <system_error>
+// std::bad_alloc
+#include <new>
+
+namespace jvn
+{
+
+    // The parallel build and rehash of unordered_map (map.h) and unordered_set (set.h), in their own
+    // header so the maps that don't use threads don't include <thread>. jvn::set_thread_count() sets
+    // a function pointer the grow() of a map calls for large tables, the grow() of every other map
+    // only checks that it's null.
+
+    // The table is split into regions of consecutive slots, a thread places the elements of one
+    // region at a time. Before the new bucket becomes the map's each element is hashed into an
+    // entry, the entries of a chunk of the input are grouped by region in place. A hash or an
+    // allocation that throws then leaves the map as it was. The elements whose probe or shift would
+    // cross into the next region are placed after the threads join, their entries are moved to the
+    // front of the group instead of being copied to a list.
+    template <class Map>
+    struct parallel_ops
+    {
+        using size_type = typename Map::size_type;
+        using slot_type = typename Map::slot_type;
+
+        // The table of an unordered_map, or the one an unordered_set privately derives from
+        template <class Container>
+        static Map& table(Container& container) noexcept { return container; }
+
+        static void setThreadCount(Map& map, size_type thread_count)
+        {
+            map.m_thread_count = thread_count ? thread_count : size_type(std::thread::hardware_concurrency());
+            if (!map.m_thread_count)
+                map.m_thread_count = 1;
+            map.m_rehash_parallel = map.m_thread_count > 1 ? &rehash : nullptr;
+        }
+
+        template <class RandomIt>
+        static void insert(Map& map, RandomIt first, RandomIt last)
+        {
+            auto count = size_type(last - first);
+            map.reserve(map.m_size + count);
+            if (map.m_thread_count < 2 || count < Map::PARALLEL_MIN)
+                map.insertRange(first, last, std::random_access_iterator_tag());
+            else
+                insert(map, first, count, std::integral_constant<bool, Map::storage_type::node_based>());
+        }
+
+        // Map::rehashTo() on map.m_thread_count threads. If moving an element throws, the elements
+        // not moved yet are destroyed with the old bucket as by rehashTo()
+        static void rehash(Map& map, size_type capacity)
+        {
+            partition parts(map, map.m_capacity, map.m_size, typename Map::range_type(capacity), capacity,
+                [&map](size_type idx) { return map.info(idx) != uint8_t(-1); },
+                [&map](size_type idx) { return map.hashOf(*map.slotAt(idx), typename Map::store_hash()); });
+            auto info_bucket = allocateBucket(map, capacity);
+
+            auto prev_capacity = map.m_capacity;
+            auto prev_info_bucket = map.m_info_bucket;
+            map.setBucket(info_bucket, capacity);
+            // Counted back up as the elements are placed
+            auto count = map.m_size;
+            map.m_size = 0;
+            // A moved element's old slot is marked empty, so a throw only leaves the others to release
+            auto prevInfo = [prev_info_bucket, prev_capacity](size_type idx) -> uint8_t&
+                { return *Map::layout_type::template info<slot_type>(prev_info_bucket, prev_capacity, idx); };
+            auto prevSlot = [prev_info_bucket, prev_capacity](size_type idx)
+                { return Map::layout_type::template value<slot_type>(prev_info_bucket, prev_capacity, idx); };
+            try
+            {
+                parts.place(map,
+                    [&map, prevInfo, prevSlot](size_type idx, size_t hash, size_type region_end)
+                    {
+                        auto result = placeInRegion(map, typename Map::absent_key{}, hash, region_end, std::move(prevSlot(idx)->value));
+                        if (result == region_result::placed)
+                        {
+                            prevSlot(idx)->~slot_type();
+                            prevInfo(idx) = uint8_t(-1);
+                        }
+                        return result;
+                    },
+                    [&map, prevInfo, prevSlot, count](size_type idx, size_t hash)
+                    {
+                        map.placeRehashed(hash, count, std::move(prevSlot(idx)->value));
+                        prevSlot(idx)->~slot_type();
+                        prevInfo(idx) = uint8_t(-1);
+                        ++map.m_size;
+                    });
+            }
+            catch (...)
+            {
+                map.releasePrevious(prev_info_bucket, prev_capacity, 0);
+                throw;
+            }
+            map.deallocateBucket(prev_info_bucket, prev_capacity);
+        }
+
+    private:
+        // The smallest region of a parallel build or rehash, much longer than the clusters so only
+        // a few elements are left for after the threads join
+        static JVN_INLINE_VAR constexpr size_type REGION_MIN = 1024;
+
+        // The outcome of placeInRegion()
+        enum class region_result { placed, found, overflow };
+
+        // An element to place, the index of its pair in the range or of its slot in the old bucket
+        struct entry
+        {
+            size_type idx;
+            size_t hash;
+        };
+
+        // The entries of the elements of a range or of an old bucket, split into count chunks of the
+        // input and grouped by region inside each chunk. The group of chunk c and region r starts at
+        // m_starts[c * m_region_count + r] and holds m_counts[c * m_region_count + r] entries
+        class partition
+        {
+        public:
+            // Hashes the elements of [0, count), hasElement(i) is false for an index without an
+            // element and hashAt(i) is invoked once per element. elements is the number of them,
+            // range reduces the hashes for a table of capacity slots
+            template <class HasFn, class HashFn>
+            partition(const Map& map, size_type count, size_type elements, const typename Map::range_type& range,
+                size_type capacity, HasFn&& hasElement, HashFn&& hashAt)
+                :m_chunk_count(map.m_thread_count), m_region_count(closest_power_of_two(map.m_thread_count * 8))
+            {
+                while (m_region_count > 1 && capacity / m_region_count < REGION_MIN)
+                    m_region_count /= 2;
+                auto region_size = capacity / m_region_count;
+                while ((size_type(1) << m_region_shift) != region_size)
+                    ++m_region_shift;
+                auto chunkBegin = [count, this](size_type chunk) { return count / m_chunk_count * chunk; };
+                auto chunkEnd = [count, this](size_type chunk)
+                    { return chunk + 1 == m_chunk_count ? count : count / m_chunk_count * (chunk + 1); };
+                auto regionOf = [&range, this](size_t hash) { return size_type(range(hash)) >> m_region_shift; };
+
+                // The entries of a chunk start after the elements of the chunks before it
+                m_entries.resize(elements);
+                m_counts.resize(m_chunk_count * m_region_count);
+                m_starts.resize(m_chunk_count * m_region_count);
+                std::vector<size_type> chunk_begin(m_chunk_count + 1);
+                runParallel(map, m_chunk_count, [&](size_type chunk)
+                {
+                    size_type chunk_elements = 0;
+                    for (auto i = chunkBegin(chunk); i != chunkEnd(chunk); ++i)
+                        chunk_elements += size_type(hasElement(i));
+                    chunk_begin[chunk + 1] = chunk_elements;
+                });
+                for (size_type chunk = 0; chunk != m_chunk_count; ++chunk)
+                    chunk_begin[chunk + 1] += chunk_begin[chunk];
+
+                runParallel(map, m_chunk_count, [&](size_type chunk)
+                {
+                    auto counts = &m_counts[chunk * m_region_count];
+                    auto starts = &m_starts[chunk * m_region_count];
+                    auto out = chunk_begin[chunk];
+                    for (auto i = chunkBegin(chunk); i != chunkEnd(chunk); ++i)
+                        if (hasElement(i))
+                        {
+                            auto hash = hashAt(i);
+                            m_entries[out++] = entry{ i, hash };
+                            ++counts[regionOf(hash)];
+                        }
+
+                    // Groups the entries of the chunk by region, each swap puts one entry in its group
+                    auto start = chunk_begin[chunk];
+                    for (size_type region = 0; region != m_region_count; ++region)
+                    {
+                        starts[region] = start;
+                        start += counts[region];
+                    }
+                    std::vector<size_type> next(starts, starts + m_region_count);
+                    for (size_type region = 0; region != m_region_count; ++region)
+                        while (next[region] != starts[region] + counts[region])
+                        {
+                            auto target = regionOf(m_entries[next[region]].hash);
+                            if (target == region)
+                                ++next[region];
+                            else
+                                std::swap(m_entries[next[region]], m_entries[next[target]++]);
+                        }
+                });
+            }
+
+            // Places the entries, placeAt(i, hash, region_end) places an element inside its region
+            // or returns overflow and placeLast(i, hash) places the overflowed elements after the
+            // threads join. map.m_size counts the elements placeAt() placed even if one throws
+            template <class RegionFn, class LastFn>
+            void place(Map& map, RegionFn&& placeAt, LastFn&& placeLast)
+            {
+                // Written once per region, so the threads don't share a counter
+                std::vector<size_type> placed(m_region_count);
+                try
+                {
+                    runParallel(map, m_region_count, [&](size_type region)
+                    {
+                        size_type region_placed = 0;
+                        try
+                        {
+                            for (size_type chunk = 0; chunk != m_chunk_count; ++chunk)
+                            {
+                                auto group = chunk * m_region_count + region;
+                                auto overflow = m_starts[group];
+                                for (auto j = m_starts[group]; j != m_starts[group] + m_counts[group]; ++j)
+                                {
+                                    auto result = placeAt(m_entries[j].idx, m_entries[j].hash, (region + 1) << m_region_shift);
+                                    if (result == region_result::overflow)
+                                        m_entries[overflow++] = m_entries[j];
+                                    else if (result == region_result::placed)
+                                        ++region_placed;
+                                }
+                                m_counts[group] = overflow - m_starts[group];
+                            }
+                        }
+                        catch (...)
+                        {
+                            placed[region] = region_placed;
+                            throw;
+                        }
+                        placed[region] = region_placed;
+                    });
+                }
+                catch (...)
+                {
+                    for (auto region_placed : placed)
+                        map.m_size += region_placed;
+                    throw;
+                }
+                for (auto region_placed : placed)
+                    map.m_size += region_placed;
+
+                for (size_type group = 0; group != m_counts.size(); ++group)
+                    for (auto j = m_starts[group]; j != m_starts[group] + m_counts[group]; ++j)
+                        placeLast(m_entries[j].idx, m_entries[j].hash);
+            }
+
+        private:
+            size_type m_chunk_count;
+            size_type m_region_count;
+            int m_region_shift = 0;
+            std::vector<entry> m_entries;
+            std::vector<size_type> m_counts;
+            std::vector<size_type> m_starts;
+        };
+
+        // Places an element for a thread of a parallel build or rehash, which owns the slots from the
+        // start of the region of hash up to region_end. Nothing past the region is read or written,
+        // an element whose probe or shift would reach past it or past DISPLACEMENT_LIMIT isn't placed
+        template <class K, class... Args>
+        static region_result placeInRegion(Map& map, const K& key, size_t hash, size_type region_end, Args&&... args)
+        {
+            auto idx = map.trim(hash);
+            auto id = uint8_t(0);
+            for (;; ++idx, ++id)
+            {
+                if (idx == region_end || id > Map::DISPLACEMENT_LIMIT)
+                    return region_result::overflow;
+                if (map.info(idx) == uint8_t(-1) || map.info(idx) < id)
+                    break;
+                if (map.info(idx) == id && map.keyMatches(idx, key, hash))
+                    return region_result::found;
+            }
+            // The cluster shifted by the element has to end inside the region
+            for (auto idx_empty = idx; map.info(idx_empty) != uint8_t(-1); )
+                if (map.info(idx_empty) >= Map::DISPLACEMENT_LIMIT || ++idx_empty == region_end)
+                    return region_result::overflow;
+            map.place(idx, id, hash, std::forward<Args>(args)...);
+            return region_result::placed;
+        }
+
+        template <class RandomIt>
+        static void insert(Map& map, RandomIt first, size_type count, std::false_type)
+        {
+            partition parts(map, count, count, map.m_range, map.m_capacity,
+                [](size_type) { return true; },
+                [first, &map](size_type i) { return map.m_hasher(Map::keyOf(first[i])); });
+            parts.place(map,
+                [first, &map](size_type i, size_t hash, size_type region_end)
+                    { return placeInRegion(map, Map::keyOf(first[i]), hash, region_end, first[i]); },
+                [first, &map](size_type i, size_t hash) { map.emplaceUnchecked(hash, first[i]); });
+        }
+
+        // The node pool isn't thread safe
+        template <class RandomIt>
+        static void insert(Map& map, RandomIt first, size_type count, std::true_type)
+        {
+            map.insertRange(first, first + typename Map::difference_type(count), std::random_access_iterator_tag());
+        }
+
+        // Map::allocateBucket() with the info bytes cleared by the threads, since that alone page
+        // faults the whole allocation
+        static uint8_t* allocateBucket(Map& map, size_type capacity)
+        {
+            auto info_bucket = map.allocateRaw(capacity);
+            auto parts = capacity / Map::PARALLEL_MIN * 4;
+            runParallel(map, parts, [info_bucket, capacity, parts](size_type part)
+                { Map::clearInfo(info_bucket, capacity, capacity / parts * part, capacity / parts * (part + 1)); });
+            return info_bucket;
+        }
+
+        // Invokes func(part) for the parts [0, parts) on up to map.m_thread_count threads, the
+        // calling thread included. The first exception thrown is rethrown once all of the threads
+        // finish. If a thread can't be started the parts are shared by fewer threads
+        template <class Func>
+        static void runParallel(const Map& map, size_type parts, Func&& func)
+        {
+            std::atomic<size_type> next(0);
+            std::exception_ptr error;
+            std::mutex error_lock;
+            auto worker = [&]()
+            {
+                try
+                {
+                    for (auto part = next++; part < parts; part = next++)
+                        func(part);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_lock);
+                    if (!error)
+                        error = std::current_exception();
+                    next = parts;
+                }
+            };
+
+            std::vector<std::thread> threads;
+            try
+            {
+                threads.reserve(map.m_thread_count);
+                for (size_type idx = 1; idx < map.m_thread_count && idx < parts; ++idx)
+                    threads.emplace_back(worker);
+            }
+            catch (const std::system_error&)
+            {
+                // Fewer threads then
+            }
+            catch (const std::bad_alloc&)
+            {
+            }
+            worker();
+            for (auto& thread : threads)
+                thread.join();
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+
+    template <class Kt, class Hasher, class KeyEq, class Alloc, class Layout, bool StoreHash, class Storage, class Range>
+    class unordered_set;
+
+    // The unordered_map holding the elements of a container
+    template <class Container>
+    struct table_of { using type = Container; };
+
+    template <class Kt, class Hasher, class KeyEq, class Alloc, class Layout, bool StoreHash, class Storage, class Range>
+    struct table_of<unordered_set<Kt, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage, Range>>
+    { using type = unordered_map<Kt, void, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage, Range>; };
+
+    // Sets the number of threads used by insert_parallel() and by grow(), rehash() and reserve() of
+    // the tables of at least PARALLEL_MIN slots of an unordered_map or unordered_set, 0 for
+    // std::thread::hardware_concurrency(). The default is 1, i.e. no threads are started. The hasher
+    // and key_equal are then invoked concurrently and the JVN_MAP_COUNTERS counters are unreliable
+    template <class Container>
+    void set_thread_count(Container& container, size_t thread_count)
+    {
+        using ops = parallel_ops<typename table_of<Container>::type>;
+        ops::setThreadCount(ops::table(container), thread_count);
+    }
+
+    // Inserts the range on container.thread_count() threads, for building large tables. The table is
+    // reserved for the whole range and split into regions of consecutive slots, the elements
+    // are grouped by the region of their hash position and each thread places the elements of
+    // one region at a time. The few elements whose probe or shift would cross into the next
+    // region are placed after the threads join. With equal keys in the range it's unspecified
+    // which of the pairs is kept, move iterators move the pairs. A node_map, a small range or
+    // a thread_count() of 1 inserts on the calling thread
+    template <class Container, class RandomIt>
+    void insert_parallel(Container& container, RandomIt first, RandomIt last)
+    {
+        using ops = parallel_ops<typename table_of<Container>::type>;
+        ops::insert(ops::table(container), first, last);
+    }
+
+} // namespace jvn
@@ -0,0 +1,81 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+
+namespace jvn
+{
+
+    // A hashset on the Robin Hood table of unordered_map, the probing, the shifts of insert and
+    // erase and grow() are the map's. The slots hold the keys alone, so a set of ints takes an
+    // info byte and 4 bytes per slot with the default layout, where an unordered_map<int, bool>
+    // takes 9, so nearly twice as many slots fit in a cache line.
+    // The layouts, StoreHash, the storages and the ranges are the same as for unordered_map (map.h).
+    template <class Kt, class Hasher = hash<Kt>, class KeyEq = equal_to<Kt>, class Alloc = std::allocator<Kt>,
+        class Layout = interleaved_layout, bool StoreHash = false, class Storage = flat_storage,
+        class Range = default_range_t<Hasher>>
+        class unordered_set : private unordered_map<Kt, void, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage, Range>
+    {
+        using base = unordered_map<Kt, void, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage, Range>;
+        // jvn::set_thread_count() and jvn::insert_parallel() (parallel.h) reach the table through it
+        friend struct parallel_ops<base>;
+    public:
+        using hasher                = Hasher;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = Kt;
+        using pointer               = const value_type*;
+        using reference             = const value_type&;
+        using const_reference       = const value_type&;
+        using size_type             = typename base::size_type;
+        using difference_type       = typename base::difference_type;
+        using allocator_type        = Alloc;
+        using layout_type           = Layout;
+        using range_type            = Range;
+        using iterator              = typename base::iterator;
+        using const_iterator        = typename base::iterator;
+
+        // The same constructors as unordered_map, the ranges and the vector hold keys
+        using base::base;
+
+        pair<iterator, bool> insert(const value_type& key) { return base::insert(key); }
+        pair<iterator, bool> insert(value_type&& key) { return base::insert(std::move(key)); }
+
+        template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+        void insert(InputIt first, InputIt last) { base::insert(first, last); }
+
+        // The key is constructed before it's looked up
+        template <class... Args>
+        pair<iterator, bool> emplace(Args&&... args)
+        {
+            value_type key(std::forward<Args>(args)...);
+            return base::insert(std::move(key));
+        }
+
+        using base::find;
+        using base::contains;
+        using base::count;
+        using base::find_batch;
+        using base::contains_batch;
+        using base::erase;
+        using base::erase_if;
+
+        using base::reserve;
+        using base::rehash;
+        using base::shrink_to_fit;
+        using base::thread_count;
+
+        using base::size;
+        using base::empty;
+        using base::bucket_count;
+        using base::load_factor;
+        using base::max_load_factor;
+        using base::hash_function;
+        using base::key_eq;
+        using base::get_allocator;
+        using base::stats;
+
+        using base::begin;
+        using base::end;
+    };
+
+} // namespace jvn
@@ -0,0 +1,248 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "map.h"
+
+namespace jvn
+{
+
+    // An unordered_map that keeps up to N elements in the object itself, for the many maps that
+    // only ever hold a few elements, e.g. one per session or per object. The inline elements are
+    // searched linearly with key_equal, they're never hashed and nothing is allocated. Inserting
+    // the element past N moves them to the Robin Hood table, which is used from then on even if
+    // the elements are erased again. The table allocates its bucket at that point, as any new
+    // unordered_map only allocates on its first insert.
+
+    // The inline elements aren't kept in order, erase() moves the last one into the erased slot.
+    // An insert or erase invalidates the iterators, the references of the inline elements as well.
+    template <class Kt, class Vt, size_t N = 8, class Hasher = hash<Kt>,
+        class KeyEq = equal_to<Kt>, class Alloc = std::allocator<pair<Kt, Vt>>,
+        class Layout = interleaved_layout, bool StoreHash = false, class Storage = flat_storage>
+        class small_map
+    {
+    public:
+        using map_type              = unordered_map<Kt, Vt, Hasher, KeyEq, Alloc, Layout, StoreHash, Storage>;
+        using hasher                = Hasher;
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = pair<Kt, Vt>;
+        using pointer               = value_type*;
+        using reference             = value_type&;
+        using const_reference       = const value_type&;
+        using size_type             = typename map_type::size_type;
+        using difference_type       = typename map_type::difference_type;
+        using allocator_type        = Alloc;
+
+        static_assert(N > 0, "jvn::small_map needs room for at least one inline element");
+
+        // Walks the inline elements or the table, whichever holds the elements
+        class Iter
+        {
+        public:
+            using iterator_category     = std::forward_iterator_tag;
+            using value_type            = typename small_map::value_type;
+            using difference_type       = typename small_map::difference_type;
+            using pointer               = typename small_map::pointer;
+            using reference             = typename small_map::const_reference;
+
+            Iter(const small_map* map, size_type idx, typename map_type::iterator iter)
+                :m_map(map), m_idx(idx), m_iter(iter) {}
+
+            friend bool operator==(const Iter& lhs, const Iter& rhs) { return lhs.m_idx == rhs.m_idx && lhs.m_iter == rhs.m_iter; }
+            friend bool operator!=(const Iter& lhs, const Iter& rhs) { return !(lhs == rhs); }
+            Iter& operator++()
+            {
+                if (m_map->m_inline)
+                    ++m_idx;
+                else
+                    ++m_iter;
+                return *this;
+            }
+            pointer operator->() const { return m_map->m_inline ? m_map->inlineAt(m_idx) : m_iter.operator->(); }
+            reference operator*() const { return *operator->(); }
+        private:
+            const small_map* m_map;
+            size_type m_idx;
+            typename map_type::iterator m_iter;
+        };
+
+        friend class Iter;
+        using iterator              = Iter;
+
+        // The arguments are those of unordered_map, the initial capacity is that of the table
+        small_map(float load_factor = 0.75f, size_type inital_capacity = 128u, size_type growth_factor = 16u,
+            const hasher& hash = hasher(), const key_equal& equal = key_equal(), const allocator_type& alloc = allocator_type())
+            :m_map(load_factor, inital_capacity, growth_factor, hash, equal, alloc)
+        {}
+
+        small_map(const small_map&) = delete;
+        small_map& operator=(const small_map&) = delete;
+
+        ~small_map()
+        {
+            for (size_type idx = 0; idx != m_inline_size; ++idx)
+                inlineAt(idx)->~value_type();
+        }
+
+        mapped_type& operator[](const key_type& key) { return try_emplace(key).first->second; }
+        mapped_type& operator[](key_type&& key) { return try_emplace(std::move(key)).first->second; }
+
+        iterator find(const key_type& key) const { return lookup(key); }
+        bool contains(const key_type& key) const { return lookup(key) != end(); }
+        size_type count(const key_type& key) const { return size_type(contains(key)); }
+
+        template <class Ty, std::enable_if_t<std::is_same<std::decay_t<Ty>, value_type>::value, int> = 0>
+        pair<iterator, bool> insert(Ty&& key_value_pair)
+        {
+            return emplaceKey(key_value_pair.first, std::forward<Ty>(key_value_pair));
+        }
+
+        template <class K, class V, std::enable_if_t<std::is_same<std::decay_t<K>, key_type>::value, int> = 0>
+        pair<iterator, bool> emplace(K&& key, V&& value)
+        {
+            return emplaceKey(key, std::forward<K>(key), std::forward<V>(value));
+        }
+
+        template <class... Args>
+        pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template <class... Args>
+        pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+        {
+            return emplaceKey(key, std::piecewise_construct,
+                std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template <class M>
+        pair<iterator, bool> insert_or_assign(const key_type& key, M&& value)
+        {
+            auto result = try_emplace(key, std::forward<M>(value));
+            if (!result.second)
+                result.first->second = std::forward<M>(value);
+            return result;
+        }
+
+        size_type erase(const key_type& key)
+        {
+            if (!m_inline)
+                return m_map.erase(key);
+            auto idx = inlineFind(key);
+            if (idx == m_inline_size)
+                return size_type(0);
+
+            auto last = m_inline_size - 1;
+            if (idx != last)
+                *inlineAt(idx) = std::move(*inlineAt(last));
+            inlineAt(last)->~value_type();
+            m_inline_size = last;
+            return size_type(1);
+        }
+
+        // Moves the elements to the table if count of them don't fit inline
+        void reserve(size_type count)
+        {
+            if (m_inline && count > N)
+                moveToTable(count);
+            else if (!m_inline)
+                m_map.reserve(count);
+        }
+
+        // Whether the elements are still inline
+        bool is_inline() const noexcept { return m_inline; }
+
+        size_type size() const noexcept { return m_inline ? m_inline_size : m_map.size(); }
+        bool empty() const noexcept { return !size(); }
+        // 0 while the elements are inline
+        size_type bucket_count() const noexcept { return m_map.bucket_count(); }
+        float max_load_factor() const noexcept { return m_map.max_load_factor(); }
+        hasher hash_function() const { return m_map.hash_function(); }
+        key_equal key_eq() const { return m_map.key_eq(); }
+        allocator_type get_allocator() const { return m_map.get_allocator(); }
+
+        iterator begin() const { return iterator(this, 0, m_map.begin()); }
+        iterator end() const { return iterator(this, m_inline ? m_inline_size : size_type(0), m_map.end()); }
+
+    private:
+        // Holds the hasher and key_equal while the elements are inline, without a bucket
+        map_type m_map;
+        bool m_inline = true;
+        size_type m_inline_size = 0;
+        alignas(value_type) unsigned char m_inline_bytes[N * sizeof(value_type)];
+
+        value_type* inlineAt(size_type idx) const noexcept
+        { return const_cast<value_type*>(reinterpret_cast<const value_type*>(m_inline_bytes)) + idx; }
+
+        // The index of the inline element with the key, m_inline_size if there is none
+        size_type inlineFind(const key_type& key) const
+        {
+            size_type idx = 0;
+            while (idx != m_inline_size && !m_map.m_key_equal(inlineAt(idx)->first, key))
+                ++idx;
+            return idx;
+        }
+
+        iterator lookup(const key_type& key) const
+        {
+            if (!m_inline)
+                return iterator(this, 0, m_map.find(key));
+            return iterator(this, inlineFind(key), m_map.end());
+        }
+
+        template <class... Args>
+        pair<iterator, bool> emplaceKey(const key_type& key, Args&&... args)
+        {
+            if (m_inline)
+            {
+                auto idx = inlineFind(key);
+                if (idx != m_inline_size)
+                    return pair<iterator, bool>(iterator(this, idx, m_map.end()), false);
+                if (m_inline_size != N)
+                {
+                    ::new (static_cast<void*>(inlineAt(idx))) value_type(std::forward<Args>(args)...);
+                    ++m_inline_size;
+                    return pair<iterator, bool>(iterator(this, idx, m_map.end()), true);
+                }
+                moveToTable(N + 1);
+            }
+            auto result = m_map.emplaceKey(key, std::forward<Args>(args)...);
+            return pair<iterator, bool>(iterator(this, 0, result.first), result.second);
+        }
+
+        // Allocates the table for count elements and moves the inline elements into it. Elements
+        // whose move constructor may throw are copied instead. If an insert throws the elements
+        // moved so far are moved back, the table is emptied and the map stays inline
+        void moveToTable(size_type count)
+        {
+            m_map.reserve(count);
+            size_type idx = 0;
+            try
+            {
+                for (; idx != m_inline_size; ++idx)
+                    m_map.emplaceUnchecked(std::move_if_noexcept(*inlineAt(idx)));
+            }
+            catch (...)
+            {
+                if (std::is_nothrow_move_constructible<value_type>::value)
+                {
+                    idx = 0;
+                    for (auto iter = m_map.begin(); iter != m_map.end(); ++iter, ++idx)
+                    {
+                        inlineAt(idx)->~value_type();
+                        ::new (static_cast<void*>(inlineAt(idx))) value_type(std::move(*iter.operator->()));
+                    }
+                }
+                m_map.erase_if([](const value_type&) { return true; });
+                throw;
+            }
+            for (idx = 0; idx != m_inline_size; ++idx)
+                inlineAt(idx)->~value_type();
+            m_inline_size = 0;
+            m_inline = false;
+        }
+    };
+
+} // namespace jvn
@@ -0,0 +1,197 @@
+// Copyright (c) 2020, Jovan Markovic, Email: joca.dasa@yahoo.com, All rights reserved.
+#pragma once
+#include "utility.h"
+#include "hash.h"
+// std::invalid_argument std::out_of_range
+#include <stdexcept>
+
+namespace jvn
+{
+
+    // A read only map of a fixed set of keys, built by a constexpr constructor so a table known
+    // at compile time costs nothing at startup and allocates nothing.
+
+    // The entries are kept in a flat array in the given order, a perfect hash maps every key to
+    // its own slot of a second array holding the index of the entry. The perfect hash is found
+    // at construction by hash and displace: the high bits of the key's hash pick one of about
+    // N / 2 buckets, every bucket has a pilot and a key lands on the slot
+    // mix(hash ^ pilot) & (slots - 1). The buckets are placed largest first, each takes the first
+    // pilot that puts its keys on free slots. A lookup is one hash, one integer mix, two array
+    // reads and one key comparison, there's no probing.
+
+    // For a constexpr map the Hasher and KeyEq have to be constexpr, jvn::hash is for integers
+    // and std::string_view. Duplicate keys throw std::invalid_argument, at compile time it's an error.
+    template <class Kt, class Vt, size_t N, class Hasher = hash<Kt>, class KeyEq = equal_to<Kt>>
+    class static_map
+    {
+        static_assert(N > 0, "A static_map needs at least one entry");
+
+        // Only if both Hasher and KeyEq are transparent, e.g. a const char* for a std::string_view key
+        template <class K>
+        using transparent_key = std::integral_constant<bool, is_transparent<Hasher>::value &&
+            is_transparent<KeyEq>::value && !std::is_same<K, Kt>::value>;
+    public:
+        using hasher                = Hasher;
+        using mapped_type           = Vt;
+        using key_type              = Kt;
+        using key_equal             = KeyEq;
+        using value_type            = pair<Kt, Vt>;
+        using size_type             = size_t;
+        using reference             = const value_type&;
+        using const_reference       = const value_type&;
+        using iterator              = const value_type*;
+        using const_iterator        = const value_type*;
+
+        constexpr explicit static_map(const value_type (&entries)[N], const hasher& hash = hasher(),
+            const key_equal& equal = key_equal())
+            :static_map(entries, hash, equal, std::make_index_sequence<N>())
+        {}
+
+        constexpr const_iterator find(const key_type& key) const { return lookup(key); }
+
+        template <class K, std::enable_if_t<transparent_key<K>::value, int> = 0>
+        constexpr const_iterator find(const K& key) const { return lookup(key); }
+
+        constexpr bool contains(const key_type& key) const { return lookup(key) != end(); }
+
+        template <class K, std::enable_if_t<transparent_key<K>::value, int> = 0>
+        constexpr bool contains(const K& key) const { return lookup(key) != end(); }
+
+        constexpr size_type count(const key_type& key) const { return contains(key); }
+
+        // Throws std::out_of_range if the key isn't in the map
+        constexpr const mapped_type& at(const key_type& key) const
+        {
+            auto iter = lookup(key);
+            if (iter == end())
+                throw std::out_of_range("jvn::static_map::at: key not found");
+            return iter->second;
+        }
+
+        // The entries in the order they were given
+        constexpr const_iterator begin() const noexcept { return m_entries; }
+        constexpr const_iterator end() const noexcept { return m_entries + N; }
+
+        constexpr size_type size() const noexcept { return N; }
+        constexpr bool empty() const noexcept { return false; }
+        constexpr size_type bucket_count() const noexcept { return SLOTS; }
+
+        constexpr hasher hash_function() const { return m_hasher; }
+        constexpr key_equal key_eq() const { return m_key_equal; }
+
+    private:
+        // The load factor of the slots is between 0.4 and 0.8 and there are two keys per bucket on
+        // average, more slots or buckets make the pilots faster to find at the cost of memory
+        static JVN_INLINE_VAR constexpr size_type SLOTS = closest_power_of_two(N + N / 4);
+        static JVN_INLINE_VAR constexpr size_type BUCKETS = closest_power_of_two(N / 2);
+        // A bucket whose keys don't fit after this many pilots has keys with equal hashes
+        static JVN_INLINE_VAR constexpr uint32_t MAX_PILOT = 1u << 16;
+        // Marks a slot without an entry
+        static JVN_INLINE_VAR constexpr uint32_t EMPTY = uint32_t(-1);
+
+        value_type m_entries[N];
+        uint32_t m_slots[SLOTS];
+        uint32_t m_pilots[BUCKETS];
+        hasher m_hasher;
+        key_equal m_key_equal;
+
+        template <size_t... Idx>
+        constexpr static_map(const value_type (&entries)[N], const hasher& hash, const key_equal& equal,
+            std::index_sequence<Idx...>)
+            :m_entries{ entries[Idx]... }, m_slots(), m_pilots(), m_hasher(hash), m_key_equal(equal)
+        {
+            build();
+        }
+
+        // The bucket takes the high half of the hash so it's independent of the slot
+        static constexpr size_type bucketOf(size_t hash) noexcept
+        {
+            return (hash >> (JVN(BITNESS) / 2)) & (BUCKETS - 1);
+        }
+        static constexpr size_type slotOf(size_t hash, uint32_t pilot) noexcept
+        {
+            return murmur_hash::murmur_hash3_int(hash ^ pilot) & (SLOTS - 1);
+        }
+
+        template <class K>
+        constexpr const_iterator lookup(const K& key) const
+        {
+            auto hash = m_hasher(key);
+            auto idx = m_slots[slotOf(hash, m_pilots[bucketOf(hash)])];
+            return idx != EMPTY && m_key_equal(m_entries[idx].first, key) ? m_entries + idx : end();
+        }
+
+        constexpr void build()
+        {
+            size_t hashes[N] = {};
+            // The entries sorted by bucket, the ones of bucket b are [starts[b], starts[b + 1])
+            uint32_t members[N] = {};
+            uint32_t starts[BUCKETS + 1] = {};
+            for (size_type idx = 0; idx != N; ++idx)
+            {
+                hashes[idx] = m_hasher(m_entries[idx].first);
+                ++starts[bucketOf(hashes[idx]) + 1];
+            }
+            size_type largest = 0;
+            for (size_type bucket = 0; bucket != BUCKETS; ++bucket)
+            {
+                largest = starts[bucket + 1] > largest ? starts[bucket + 1] : largest;
+                starts[bucket + 1] += starts[bucket];
+            }
+            uint32_t filled[BUCKETS] = {};
+            for (size_type idx = 0; idx != N; ++idx)
+            {
+                auto bucket = bucketOf(hashes[idx]);
+                members[starts[bucket] + filled[bucket]++] = uint32_t(idx);
+            }
+
+            for (size_type slot = 0; slot != SLOTS; ++slot)
+                m_slots[slot] = EMPTY;
+
+            // Largest buckets first, while most of the slots are still free
+            for (auto bucket_size = largest; bucket_size != 0; --bucket_size)
+                for (size_type bucket = 0; bucket != BUCKETS; ++bucket)
+                    if (starts[bucket + 1] - starts[bucket] == bucket_size)
+                        placeBucket(bucket, hashes, members + starts[bucket], bucket_size);
+        }
+
+        constexpr void placeBucket(size_type bucket, const size_t* hashes, const uint32_t* members, size_type count)
+        {
+            for (size_type i = 0; i != count; ++i)
+                for (size_type j = i + 1; j != count; ++j)
+                    if (m_key_equal(m_entries[members[i]].first, m_entries[members[j]].first))
+                        throw std::invalid_argument("jvn::static_map: duplicate keys");
+
+            for (uint32_t pilot = 0; pilot != MAX_PILOT; ++pilot)
+            {
+                auto fits = true;
+                for (size_type i = 0; i != count && fits; ++i)
+                {
+                    auto slot = slotOf(hashes[members[i]], pilot);
+                    fits = m_slots[slot] == EMPTY;
+                    // The slot may be taken by a key of the same bucket placed with this pilot
+                    for (size_type j = 0; j != i && fits; ++j)
+                        fits = slot != slotOf(hashes[members[j]], pilot);
+                }
+                if (!fits)
+                    continue;
+
+                m_pilots[bucket] = pilot;
+                for (size_type i = 0; i != count; ++i)
+                    m_slots[slotOf(hashes[members[i]], pilot)] = members[i];
+                return;
+            }
+            throw std::invalid_argument("jvn::static_map: keys with equal hashes");
+        }
+    };
+
+    // Deduces the number of entries, e.g.
+    // constexpr auto methods = jvn::make_static_map<std::string_view, int>({ { "GET", 0 }, { "POST", 1 } });
+    template <class Kt, class Vt, class Hasher = hash<Kt>, class KeyEq = equal_to<Kt>, size_t N>
+    constexpr static_map<Kt, Vt, N, Hasher, KeyEq> make_static_map(const pair<Kt, Vt> (&entries)[N],
+        const Hasher& hash = Hasher(), const KeyEq& equal = KeyEq())
+    {
+        return static_map<Kt, Vt, N, Hasher, KeyEq>(entries, hash, equal);
+    }
+
+} // namespace jvn
@@ -1,88 +1,135 @@
-#pragma once
-// std::...
-#include <utility>
-
-namespace jvn
-{
-
-// A function object that invokes operator== on Ty type
-template <class Ty>
-struct equal_to 
-{
-    constexpr bool operator()(const Ty& lhs, const Ty& rhs) const { return lhs == rhs; }
-};
-
-// A custom pair implementation that is is_trivially_copyable
-template <class Ty1, class Ty2>
-struct pair 
-{
-    using first_type    = Ty1;
-    using second_type   = Ty2;
-
-    template <typename U1 = Ty1, typename U2 = Ty2,
-                std::enable_if_t<std::is_default_constructible<U1>::value &&
-                std::is_default_constructible<U2>::value, int> = 0>
-    constexpr pair() noexcept(noexcept(U1()) && noexcept(U2()))
-        :first(),
-        second() 
-        {}
-
-    constexpr pair(pair const& p) noexcept(
-        noexcept(Ty1(std::declval<const Ty1&>())) && 
-        noexcept(Ty2(std::declval<const Ty2&>())))
-        :first(p.first), 
-        second(p.second) 
-        {}
-
-    constexpr pair(pair&& p) noexcept(
-        noexcept(Ty1(std::move(std::declval<Ty1&&>()))) &&
-        noexcept(Ty2(std::move(std::declval<Ty2&&>()))))
-        :first(std::move(p.first)),
-        second(std::move(p.second))
-        {}
-
-    constexpr pair(const Ty1& f, const Ty2& s) noexcept(
-        noexcept(Ty1(std::declval<const Ty1&>())) && 
-        noexcept(Ty2(std::declval<const Ty2&>())))
-        :first(f), 
-        second(s) 
-        {}
-
-    constexpr pair(Ty1&& f, Ty2&& s) noexcept(
-        noexcept(Ty1(std::move(std::declval<Ty1&&>()))) &&
-        noexcept(Ty2(std::move(std::declval<Ty2&&>()))))
-        :first(std::move(f)), 
-        second(std::move(s)) 
-        {}   
-
-    template <typename U1, typename U2>
-    constexpr pair(U1&& a, U2&& b) noexcept(
-        noexcept(Ty1(std::forward<U1>(std::declval<U1&&>()))) &&
-        noexcept(Ty2(std::forward<U2>(std::declval<U2&&>()))))
-        : first(std::forward<U1>(a))
-        , second(std::forward<U2>(b)) {}
-
-    first_type first;
-    second_type second;
-};
-
-template <class Ty1, class Ty2>
-inline constexpr bool operator==(const pair<Ty1, Ty2>& lhs, const pair<Ty1, Ty2>& rhs)
-{
-    return lhs.first == rhs.first && lhs.second == rhs.second;
-}
-
-template <class Ty1, class Ty2>
-inline constexpr bool operator!=(const pair<Ty1, Ty2>& lhs, const pair<Ty1, Ty2>& rhs) { return !(lhs == rhs); }
-
-// TODO : Add no except boundary
-template <class Ty1, class Ty2>
-inline void swap(pair<Ty1, Ty2>& lhs, pair<Ty1, Ty2>& rhs) noexcept
-{
-    // Enable ADL
-    using std::swap;
-    swap(lhs.first, rhs.first);
-    swap(lhs.second, rhs.second);
-}
-
-} // namespace jvn
+#pragma once
+// std::...
+#include <utility>
+#include <type_traits>
+// std::tuple std::piecewise_construct
+#include <tuple>
+// uint32_t
+#include <stdint.h>
+// size_t
+#include <stddef.h>
+#ifdef _MSC_VER
+// _BitScanForward
+#   include <intrin.h>
+#endif
+
+namespace jvn
+{
+
+// A function object that invokes operator== on Ty type
+template <class Ty>
+struct equal_to 
+{
+    constexpr bool operator()(const Ty& lhs, const Ty& rhs) const { return lhs == rhs; }
+};
+
+// Detects the is_transparent member type of a hash or equality function object, which
+// declares that it accepts any type comparable with the key, not only the key itself
+template <class Ty, class = void>
+struct is_transparent : std::false_type {};
+
+template <class Ty>
+struct is_transparent<Ty, decltype(void(std::declval<typename Ty::is_transparent*>()))> : std::true_type {};
+
+// A custom pair implementation that is is_trivially_copyable
+template <class Ty1, class Ty2>
+struct pair 
+{
+    using first_type    = Ty1;
+    using second_type   = Ty2;
+
+    template <typename U1 = Ty1, typename U2 = Ty2,
+                std::enable_if_t<std::is_default_constructible<U1>::value &&
+                std::is_default_constructible<U2>::value, int> = 0>
+    constexpr pair() noexcept(noexcept(U1()) && noexcept(U2()))
+        :first(),
+        second() 
+        {}
+
+    // Defaulted so the pair is trivially copyable when both types are
+    constexpr pair(const pair&) = default;
+    constexpr pair(pair&&) = default;
+    pair& operator=(const pair&) = default;
+    pair& operator=(pair&&) = default;
+
+    constexpr pair(const Ty1& f, const Ty2& s) noexcept(
+        noexcept(Ty1(std::declval<const Ty1&>())) && 
+        noexcept(Ty2(std::declval<const Ty2&>())))
+        :first(f), 
+        second(s) 
+        {}
+
+    constexpr pair(Ty1&& f, Ty2&& s) noexcept(
+        noexcept(Ty1(std::move(std::declval<Ty1&&>()))) &&
+        noexcept(Ty2(std::move(std::declval<Ty2&&>()))))
+        :first(std::move(f)), 
+        second(std::move(s)) 
+        {}   
+
+    template <typename U1, typename U2>
+    constexpr pair(U1&& a, U2&& b) noexcept(
+        noexcept(Ty1(std::forward<U1>(std::declval<U1&&>()))) &&
+        noexcept(Ty2(std::forward<U2>(std::declval<U2&&>()))))
+        : first(std::forward<U1>(a))
+        , second(std::forward<U2>(b)) {}
+
+    // Constructs first and second in place from the elements of the tuples
+    template <typename... Args1, typename... Args2>
+    constexpr pair(std::piecewise_construct_t, std::tuple<Args1...> first_args, std::tuple<Args2...> second_args)
+        :pair(first_args, second_args, std::index_sequence_for<Args1...>(), std::index_sequence_for<Args2...>())
+        {}
+
+    first_type first;
+    second_type second;
+
+private:
+    template <typename Tuple1, typename Tuple2, std::size_t... Idx1, std::size_t... Idx2>
+    constexpr pair(Tuple1& first_args, Tuple2& second_args, std::index_sequence<Idx1...>, std::index_sequence<Idx2...>)
+        :first(std::get<Idx1>(std::move(first_args))...),
+        second(std::get<Idx2>(std::move(second_args))...)
+        {}
+};
+
+template <class Ty1, class Ty2>
+inline constexpr bool operator==(const pair<Ty1, Ty2>& lhs, const pair<Ty1, Ty2>& rhs)
+{
+    return lhs.first == rhs.first && lhs.second == rhs.second;
+}
+
+template <class Ty1, class Ty2>
+inline constexpr bool operator!=(const pair<Ty1, Ty2>& lhs, const pair<Ty1, Ty2>& rhs) { return !(lhs == rhs); }
+
+// TODO : Add no except boundary
+template <class Ty1, class Ty2>
+inline void swap(pair<Ty1, Ty2>& lhs, pair<Ty1, Ty2>& rhs) noexcept
+{
+    // Enable ADL
+    using std::swap;
+    swap(lhs.first, rhs.first);
+    swap(lhs.second, rhs.second);
+}
+
+// Returns the first equal or bigger power of two, return value is always greater than 1
+constexpr size_t closest_power_of_two(size_t num) noexcept
+{
+    if (num < 2)
+        return 2u;
+    num--;
+    for (size_t shift = 1; shift < sizeof(size_t) * 8; shift <<= 1)
+        num |= num >> shift;
+    return num + 1;
+}
+
+// Index of the lowest set bit, mask must not be zero
+inline int countr_zero(uint32_t mask) noexcept
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return int(idx);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+} // namespace jvn